@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# generates synthetic site for benchmarking miu
+
+import os
+import random
+import argparse
+
+WORDS = ('lorem ipsum dolor sit amet consectetur adipiscing elit sed do '
+    'eiusmod tempor incididunt ut labore et dolore magna aliqua enim ad minim '
+    'veniam quis nostrud exercitation ullamco laboris nisi aliquip ex ea '
+    'commodo consequat').split()
+
+CODE = '''```cpp
+#include <cstdio>
+
+int main() {
+    for(int i=0; i<%d; ++i) {
+        std::printf("%%d\\n", i);
+    }
+    return 0;
+}
+```
+'''
+
+def sentence(rnd, n):
+    return ' '.join(rnd.choice(WORDS) for _ in range(n)).capitalize() + '.'
+
+def paragraph(rnd):
+    return ' '.join(sentence(rnd, rnd.randint(6, 16)) for _ in range(rnd.randint(3, 7)))
+
+def post_dir(rnd, depth):
+    parts = ['blog'] + ['d%d' % rnd.randint(0, 9) for _ in range(rnd.randint(0, depth))]
+    return os.path.join(*parts)
+
+def write(path, data, mode='w'):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, mode) as f:
+        f.write(data)
+
+def generate(out, posts, tags, depth, codes, statics, seed=1):
+    rnd = random.Random(seed)
+
+    write(os.path.join(out, 'miu.conf'),
+        'title = Benchmark\n'
+        'base_url = /\n'
+        'author = miu\n')
+
+    tag_names = ['tag%d' % i for i in range(tags)]
+    files = []
+    for i in range(posts):
+        d = post_dir(rnd, depth)
+        name = 'post-%d.md' % i
+        post_tags = rnd.sample(tag_names, min(len(tag_names), rnd.randint(1, 3)))
+        created = '20%02d-%02d-%02dT%02d:%02d:00Z' % (
+            10 + i % 15, 1 + i % 12, 1 + i % 28, i % 24, i % 60)
+
+        body = []
+        for p in range(rnd.randint(2, 8)):
+            body.append(paragraph(rnd))
+            if p < codes and rnd.random() < 0.5:
+                body.append(CODE % rnd.randint(1, 100))
+
+        md = ('---\n'
+            'title = Post %d %s\n'
+            'tags = [%s]\n'
+            'created = %s\n'
+            '---\n'
+            '%s\n') % (i, rnd.choice(WORDS), ', '.join(post_tags), created,
+                '\n\n'.join(body))
+        path = os.path.join(out, 'content', d, name)
+        write(path, md)
+        files.append(os.path.relpath(path, out))
+
+    for i in range(statics):
+        d = os.path.join('static', 'assets', 'a%d' % (i % 16))
+        ext = rnd.choice(['css', 'js', 'png', 'txt'])
+        data = bytes(rnd.getrandbits(8) for _ in range(rnd.randint(256, 8192)))
+        write(os.path.join(out, d, 'file-%d.%s' % (i, ext)), data, 'wb')
+
+    return files
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(prog='gen_site.py')
+    parser.add_argument('-o', '--output', metavar='DIR', help='site directory', required=True)
+    parser.add_argument('-n', '--posts', type=int, default=1000, help='number of posts')
+    parser.add_argument('-t', '--tags', type=int, default=50, help='number of tags')
+    parser.add_argument('-d', '--depth', type=int, default=3, help='maximal directory depth')
+    parser.add_argument('-c', '--codes', type=int, default=2, help='maximal code blocks per post')
+    parser.add_argument('-s', '--static', type=int, default=100, help='number of static files')
+    parser.add_argument('--seed', type=int, default=1, help='random seed')
+
+    args = parser.parse_args()
+    generate(args.output, args.posts, args.tags, args.depth, args.codes,
+        args.static, args.seed)
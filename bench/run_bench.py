@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# times miu on synthetic site, prints results as JSON
+#
+# scenarios:
+#   rebuild  - cold `miu --rebuild`
+#   noop     - incremental run without changes
+#   edit     - one post changed, `miu file.md`
+#   template - footer template changed, incremental run
+
+import os
+import sys
+import json
+import time
+import shutil
+import argparse
+import datetime
+import subprocess
+
+from gen_site import generate
+
+def run(miu, site, *args):
+    start = time.perf_counter()
+    subprocess.run([miu, '-c', os.path.join(site, 'miu.conf')] + list(args),
+        cwd=site, check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+def bench(miu, site, posts, tags, depth, statics, repeat):
+    if os.path.exists(site):
+        shutil.rmtree(site)
+    files = generate(site, posts, tags, depth, 2, statics)
+
+    results = {}
+    def add(name, seconds):
+        results.setdefault(name, []).append(round(seconds, 6))
+
+    for r in range(repeat):
+        add('rebuild', run(miu, site, '--rebuild'))
+        add('noop', run(miu, site))
+
+        edited = os.path.join(site, files[(r * 7919) % len(files)])
+        with open(edited, 'a') as f:
+            f.write('\nEdited by benchmark run %d.\n' % r)
+        add('edit', run(miu, site, edited))
+
+        footer = os.path.join(site, 'template', 'footer.tmpl')
+        with open(footer, 'a') as f:
+            f.write('<!-- benchmark run %d -->\n' % r)
+        add('template', run(miu, site))
+
+    return {
+        'posts': posts,
+        'tags': tags,
+        'depth': depth,
+        'static': statics,
+        'seconds': {k: min(v) for k, v in results.items()},
+        'runs': results,
+    }
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(prog='run_bench.py')
+    parser.add_argument('-m', '--miu', metavar='EXE', help='miu executable', required=True)
+    parser.add_argument('-w', '--workdir', metavar='DIR', help='where to generate sites', default='bench-sites')
+    parser.add_argument('-n', '--posts', type=int, action='append', help='number of posts (repeatable)')
+    parser.add_argument('-t', '--tags', type=int, default=100, help='number of tags')
+    parser.add_argument('-d', '--depth', type=int, default=3, help='maximal directory depth')
+    parser.add_argument('-s', '--static', type=int, default=200, help='number of static files')
+    parser.add_argument('-r', '--repeat', type=int, default=1, help='repeat each scenario')
+    parser.add_argument('-o', '--output', metavar='FILE', help='append JSON line with results')
+
+    args = parser.parse_args()
+    miu = os.path.abspath(args.miu)
+
+    out = {
+        'date': datetime.datetime.now(datetime.timezone.utc).strftime('%Y-%m-%dT%H:%M:%SZ'),
+        'results': [],
+    }
+    for posts in args.posts or [1000]:
+        site = os.path.abspath(os.path.join(args.workdir, 'site-%d' % posts))
+        out['results'].append(bench(miu, site, posts, args.tags, args.depth,
+            args.static, args.repeat))
+
+    line = json.dumps(out)
+    print(line)
+    if args.output:
+        with open(args.output, 'a') as f:
+            f.write(line + '\n')
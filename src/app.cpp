@@ -4,6 +4,8 @@
 #include <tuple>
 #include <fstream>
 #include <algorithm>
+#include <deque>
+#include <future>
 
 #include <fmt/core.h>
 #if __has_include(<fmt/time.h>) && FMT_VERSION < 60000
@@ -26,26 +28,21 @@
 #include "list_tmpl.h"
 #include "page_tmpl.h"
 
-#define LOG_INFO(...) do { if(config_.verbose > 0) fmt::print(__VA_ARGS__); } while(0)
-#define LOG_TRACE(...) do { if(config_.verbose > 1) fmt::print(__VA_ARGS__); } while(0)
-#define LOG_ERROR(...) do { fmt::print(stderr, __VA_ARGS__); } while(0)
+#include "pool.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+#include "log.hpp"
 
-// formatter for fs::path
-// because using fmt/ostream.h would surround path with quotes
-namespace fmt {
-template <>
-struct formatter<fs::path> {
-	template <typename ParseContext>
-	constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
-
-	template <typename FormatContext>
-	auto format(fs::path const& p, FormatContext &ctx) {
-		return format_to(ctx.out(), "{}", p.string());
+namespace {
+	// url of entry page (path can be empty for entries in root)
+	std::string entry_url(std::string const& base_url, std::string_view path,
+		std::string_view slug) {
+		if(path.empty()) {
+			return fmt::format("{}{}/", base_url, slug);
+		}
+		return fmt::format("{}{}/{}/", base_url, path, slug);
 	}
-};
-}
 
-namespace {
 	std::string const& cond_rm(std::string const& file, bool rebuild) {
 		if(rebuild) {
 			fs::remove(file);
@@ -58,13 +55,85 @@ namespace {
 		out.write(data.c_str(), data.size());
 	}
 
+	// write to temporary file next to path and rename it over path
+	// so readers never see partially written file, path is left as it
+	// was when anything fails
+	bool replace_file(fs::path const& path, std::string const& data,
+		miu::mtime_t mtime) {
+		auto tmp = path;
+		tmp += ".tmp";
+		bool created;
+		bool written;
+		{
+			std::ofstream out(tmp);
+			created = out.is_open();
+			out.write(data.c_str(), data.size());
+			written = bool(out.flush());
+		}
+
+		std::error_code ec;
+		if(written) {
+			fs::permissions(tmp, fs::status(path).permissions(), ec);
+		}
+		if(written && !ec) {
+			fs::last_write_time(tmp, mtime, ec);
+		}
+		if(written && !ec) {
+			fs::rename(tmp, path, ec);
+		}
+		if(!written || ec) {
+			LOG_ERROR("ERROR: cannot write '{}'{}\n", path,
+				ec ? ": " + ec.message() : "");
+			if(created) {
+				fs::remove(tmp, ec);
+			}
+			return false;
+		}
+		return true;
+	}
+
 	miu::mtime_t get_mtime(fs::path const& path) {
 		return fs::last_write_time(path);
 	}
 
+	// mtime as stored in cache
+	sqlite3_int64 mtime_ticks(miu::mtime_t mtime) {
+		return static_cast<sqlite3_int64>(mtime.time_since_epoch().count());
+	}
+
+	// linked and reflinked files are installed without reading them, so
+	// they are told apart by size and mtime instead of content hash
+	bool hashed_mode(miu::CopyMode mode) {
+		return mode == miu::CopyMode::Copy || mode == miu::CopyMode::CopyFileRange;
+	}
+
+	// key of static file in hash column, size and mtime key starts with
+	// name of mode ("symlink:<size>-<mtime>")
+	std::string file_key(fs::path const& path, miu::CopyMode mode,
+		miu::mtime_t mtime) {
+
+		if(hashed_mode(mode)) {
+			return miu::hash_file(path);
+		}
+		return fmt::format("{}:{:x}-{:x}", miu::copy_mode_name(mode),
+			fs::file_size(path), static_cast<uint64_t>(mtime_ticks(mtime)));
+	}
+
+	// key was made by file_key() with mode (copying modes share content hash)
+	bool same_mode(std::string const& key, miu::CopyMode mode) {
+		auto pos = key.find(':');
+		if(pos == std::string::npos) {
+			return hashed_mode(mode);
+		}
+		return key.compare(0, pos, miu::copy_mode_name(mode)) == 0;
+	}
+
 	std::string format_mtime(miu::mtime_t mtime) {
 		std::time_t cftime = miu::mtime_t::clock::to_time_t(mtime);
-		return fmt::format("{:%Y-%m-%dT%H:%M:%SZ}", *std::gmtime(&cftime));
+		// called by render workers, gmtime() shares one buffer
+		std::tm tm;
+		gmtime_r(&cftime, &tm);
+		return fmt::format("{:%Y-%m-%dT%H:%M:%SZ}", tm);
 	}
 
 	bool is_datetime(std::string const& value) {
@@ -93,22 +162,130 @@ namespace {
 
 namespace miu {
 
-App::App(int argc, char** argv) : config_(argc, argv),
-	cache_(cond_rm(config_.cache_db, config_.rebuild)) {
+App::App(int argc, char** argv) : argc_(argc), argv_(argv),
+	config_(argc, argv),
+	cache_(cond_rm(config_.cache_db, config_.rebuild)),
+	install_mode_(config_.static_mode),
+	compressor_(config_) {
 
-	std::string header = init_tmpl("header.tmpl", header_tmpl);
-	std::string footer = init_tmpl("footer.tmpl", footer_tmpl);
+	if(!config_.journal_mode.empty() && !cache_.journal_mode(config_.journal_mode)) {
+		LOG_ERROR("ERROR: unknown journal_mode '{}'\n", config_.journal_mode);
+	}
+	if(!config_.synchronous.empty() && !cache_.synchronous(config_.synchronous)) {
+		LOG_ERROR("ERROR: unknown synchronous '{}'\n", config_.synchronous);
+	}
+	cache_.batch_size(config_.batch_size);
 
-	index_tmpl_.parse(header + init_tmpl("index.tmpl", index_tmpl) + footer);
-	list_tmpl_.parse(header + init_tmpl("list.tmpl", list_tmpl) + footer);
-	page_tmpl_.parse(header + init_tmpl("page.tmpl", page_tmpl) + footer);
-	entry_tmpl_.parse(header + init_tmpl("entry.tmpl", entry_tmpl) + footer);
-	feed_tmpl_.parse(init_tmpl("feed.tmpl", feed_tmpl));
+	if(!config_.profile.empty()) {
+		profiler_.enable();
+	}
+
+	// fresh cache knows nothing about existing outputs
+	if(cache_.created()) {
+		config_.rebuild = true;
+	}
+
+	load_templates();
 }
 
 App::~App() {
 }
 
+void App::load_templates() {
+	// header and footer are partials like any other, read once and
+	// expanded into templates which do not include them on their own
+	Partials partials;
+	partials.emplace("header.tmpl", init_tmpl("header.tmpl", header_tmpl));
+	partials.emplace("footer.tmpl", init_tmpl("footer.tmpl", footer_tmpl));
+
+	auto page = [&](std::string const& name, const char* default_) {
+		std::unordered_set<std::string> included;
+		auto body = expand_includes(init_tmpl(name, default_), partials,
+			included, 0);
+		if(included.count("header.tmpl") || included.count("footer.tmpl")) {
+			return body;
+		}
+		return partials["header.tmpl"] + body + partials["footer.tmpl"];
+	};
+
+	auto index_src = page("index.tmpl", index_tmpl);
+	index_tmpl_.parse(index_src);
+	list_src_ = page("list.tmpl", list_tmpl);
+	list_tmpl_.parse(list_src_);
+	page_src_ = page("page.tmpl", page_tmpl);
+	entry_src_ = page("entry.tmpl", entry_tmpl);
+	page_tmpl_.parse(page_src_);
+	entry_tmpl_.parse(entry_src_);
+
+	std::unordered_set<std::string> included;
+	auto feed_src = expand_includes(init_tmpl("feed.tmpl", feed_tmpl),
+		partials, included, 0);
+	feed_tmpl_.parse(feed_src);
+
+	// pages show configuration too, change of either makes all of them stale
+	Hash h;
+	for(auto src : {&index_src, &list_src_, &page_src_, &entry_src_, &feed_src}) {
+		h.update(*src);
+		h.update("", 1);
+	}
+	if(!config_.config_file.empty() && fs::is_regular_file(config_.config_file)) {
+		h.update(read_file(config_.config_file));
+	}
+	templates_hash_ = h.hex();
+}
+
+std::string App::expand_includes(std::string const& src, Partials& partials,
+	std::unordered_set<std::string>& included, int depth) {
+
+	std::string ret;
+	size_t pos = 0;
+	while(1) {
+		auto start = src.find("{%", pos);
+		if(start == std::string::npos) {
+			break;
+		}
+		auto end = src.find("%}", start + 2);
+		if(end == std::string::npos) {
+			break;
+		}
+
+		// {% include "name.tmpl" %} or {% include name.tmpl %}
+		auto tag = src.substr(start + 2, end - start - 2);
+		auto b = tag.find_first_not_of(" \t");
+		if(b == std::string::npos || tag.compare(b, 8, "include ") != 0) {
+			ret.append(src, pos, end + 2 - pos);
+			pos = end + 2;
+			continue;
+		}
+		auto name = tag.substr(b + 8);
+		name.erase(0, name.find_first_not_of(" \t\""));
+		name.erase(name.find_last_not_of(" \t\"") + 1);
+
+		ret.append(src, pos, start - pos);
+		pos = end + 2;
+
+		if(depth >= 16) {
+			LOG_ERROR("ERROR: template include nested too deep: {}\n", name);
+			continue;
+		}
+
+		auto it = partials.find(name);
+		if(it == partials.end()) {
+			auto p = fs::path(config_.template_dir) / name;
+			if(!fs::is_regular_file(p)) {
+				LOG_ERROR("ERROR: included template not found: {}\n", p);
+				continue;
+			}
+			it = partials.emplace(name, read_file(p)).first;
+		}
+		included.insert(name);
+		ret += expand_includes(it->second, partials, included, depth + 1);
+	}
+	ret.append(src, pos, std::string::npos);
+
+	return ret;
+}
+
 std::string App::init_tmpl(std::string const& path, const char* default_) {
 	auto p = fs::path(config_.template_dir) / path;
 
@@ -122,11 +299,93 @@ std::string App::init_tmpl(std::string const& path, const char* default_) {
 	return default_;
 }
 
-int App::run() {
-	process_static();
+void App::record_output(const char* action, fs::path const& path,
+	uintmax_t size, std::string const& hash) {
+
+	if(config_.manifest.empty()) {
+		return;
+	}
+	auto rel = path.lexically_relative(config_.destination_dir).generic_string();
+	outputs_.push_back({action, rel, size, hash});
+}
+
+void App::write_manifest() {
+	// compressed siblings were written by workers meanwhile
+	for(auto const& c : compressor_.wait()) {
+		record_output(c.action, c.path, c.size, c.hash);
+	}
+
+	if(config_.manifest.empty()) {
+		return;
+	}
+
+	if(outputs_.empty()) {
+		return;
+	}
+
+	// records are appended until deploy truncates (or removes) manifest,
+	// so runs without deploy in between do not lose any
+	std::string data;
+	if(fs::is_regular_file(config_.manifest)) {
+		data = read_file(config_.manifest);
+	}
+	for(auto const& o : outputs_) {
+		data += fmt::format(R"~({{"action":"{}","path":"{}","size":{},"hash":"{}"}})~",
+			o.action, json_escape(o.path), o.size, o.hash);
+		data += '\n';
+	}
+	outputs_.clear();
+
+	// deploy may read it any time, never leave it half written
+	auto tmp = config_.manifest + ".tmp";
+	write_file(tmp, data);
+	fs::rename(tmp, config_.manifest);
+	LOG_TRACE("MANIFEST: {}\n", config_.manifest);
+}
+
+void App::write_output(fs::path const& path, std::string const& data) {
+	if(server_) {
+		server_->publish(path, data);
+	}
+	write_file(path, data);
+	if(compressor_.wanted(path)) {
+		compressor_.add(path, data);
+	}
+}
+
+void App::build() {
+	// templates or configuration changed since last run
+	if(cache_.state("templates") != templates_hash_) {
+		if(!config_.rebuild) {
+			LOG_INFO("TEMPLATES: changed, rendering all pages\n");
+		}
+		force_ = true;
+	}
 
-	if(config_.rebuild || config_.files.empty()) {
-		process_source();
+	// directories are walked once, files found are processed and outputs
+	// of files not found are removed (sources only when all are processed)
+	auto statics = list_files(config_.static_dir);
+	bool all_sources = config_.rebuild || config_.files.empty() || force_;
+	std::vector<fs::path> sources;
+	if(all_sources) {
+		sources = list_files(config_.source_dir);
+	}
+
+	// each phase is one transaction (or more with batch_size)
+	// so interrupted build does not leave partial state in cache
+	if(!config_.rebuild) {
+		cache_.begin("gc");
+		reconcile(statics, all_sources ? &sources : nullptr);
+		cache_.commit();
+	}
+
+	cache_.begin("static");
+	process_static(statics);
+	cache_.commit();
+
+	cache_.begin("source");
+	if(all_sources) {
+		process_source(sources);
 	}
 	if(!config_.files.empty()) {
 		for(auto const& file : config_.files) {
@@ -154,17 +413,87 @@ int App::run() {
 			process_mkd(path);
 		}
 	}
+	if(force_) {
+		cache_.mark_all();
+		cache_.set_state("templates", templates_hash_);
+	}
+	cache_.commit();
+
+	process_pages();
+	write_manifest();
+	force_ = false;
+}
+
+int App::run() {
+	// created before first build so pages it writes are published too,
+	// started after it
+	if(config_.serve) {
+		server_ = std::make_unique<Server>(config_.destination_dir,
+			config_.serve_host, config_.serve_port);
+	}
+
+	try {
+		build();
+	} catch(...) {
+		// open transactions keep writer locked, undo them before cache
+		// goes away with App
+		cache_.rollback_all();
+		throw;
+	}
+
+	LOG_TRACE("SQL: prepared statements: {} hits, {} misses, {} readers\n",
+		cache_.stmt_hits(), cache_.stmt_misses(), cache_.readers());
+
+	if(profiler_.enabled()) {
+		if(!profiler_.write(config_.profile)) {
+			LOG_ERROR("ERROR: cannot write profile '{}'\n", config_.profile);
+		}
+		profiler_.summary(static_cast<size_t>(config_.profile_top));
+	}
+
+	if(server_) {
+		if(!server_->start()) {
+			LOG_ERROR("ERROR: serve: {}\n", server_->error());
+			return 1;
+		}
+		LOG_INFO("SERVE: http://{}:{}/\n", config_.serve_host, config_.serve_port);
+	}
+
+	if(config_.watch) {
+		return watch();
+	}
 
+	return 0;
+}
+
+void App::process_pages() {
+	// only pages affected by changed entries are regenerated
+	cache_.begin("pages");
+	cache_.remove_unused_tags([&](std::string const& tag) {
+		auto info = fs::path("tags") / tag / "index.html";
+		LOG_INFO("REMOVE: {}\n", info);
+		remove_path(fs::path(config_.destination_dir) / info);
+	});
+	paths_.clear();
+	tags_.clear();
+	cache_.list_dirty_paths([&](QueryResult path) {
+		paths_.emplace(path[0]);
+	});
+	cache_.list_dirty_tags([&](QueryResult tag) {
+		tags_.emplace(tag[0]);
+	});
 	process_paths();
 	process_tags();
 	process_index();
-
-	return 0;
+	cache_.clean();
+	cache_.commit();
 }
 
 
 mtime_t App::update_file(std::string const& info,
-	fs::path const& src, fs::path const& dst) {
+	fs::path const& src, fs::path const& dst, Entry& entry) {
+
+	auto prof = profiler_.step("write");
 
 	if(!fs::exists(src) || !fs::is_regular_file(src)) {
 		LOG_INFO("FILE NOT FOUND: {}\n", src);
@@ -174,97 +503,335 @@ mtime_t App::update_file(std::string const& info,
 	auto src_mtime = get_mtime(src);
 
 	if(!config_.rebuild && fs::exists(dst)) {
+		// outputs of interrupted run are written but their rows were rolled
+		// back, such output has no row or row with other mtime and is
+		// written again (so its row and pages listing it are updated)
+		auto cached = cache_.entry_output(entry);
 		auto dst_mtime = get_mtime(dst);
+		// output installed with other static_mode is installed again (links
+		// are replaced by copies), mtime of link is mtime of source so
+		// edited source is always installed again (and compressed)
+		bool trusted = cached && cached->mtime == mtime_ticks(dst_mtime) &&
+			same_mode(cached->hash, config_.static_mode);
+
+		// mtime is only cheap pre-filter, content hash decides
+		if(trusted && config_.mtime_check && src_mtime <= dst_mtime) {
+			return mtime_t::min();
+		}
 
-		if(src_mtime > dst_mtime) {
-			LOG_INFO("UPDATE: {}\n", info);
-		} else {
+		entry.hash = file_key(src, config_.static_mode, src_mtime);
+		if(trusted && entry.hash == cached->hash) {
+			LOG_TRACE("UNCHANGED: {}\n", info);
 			return mtime_t::min();
 		}
+
+		LOG_INFO("UPDATE: {}\n", info);
 	} else {
+		entry.hash = file_key(src, config_.static_mode, src_mtime);
 		LOG_INFO("COPY: {}\n", info);
 	}
 
 	fs::create_directories(dst.parent_path());
-	fs::copy_file(src, dst, fs::copy_options::update_existing);
+	auto action = fs::exists(dst) ? "update" : "create";
+	// key stays the one of configured mode, so fallback of this run does
+	// not make outputs of next one look different
+	auto mode = install_mode_;
+	if(!install_file(src, dst, install_mode_)) {
+		LOG_ERROR("ERROR: cannot copy '{}' to '{}'\n", src, dst);
+		return mtime_t::min();
+	}
+	if(mode != install_mode_) {
+		LOG_INFO("STATIC: {} not supported, using {}\n",
+			copy_mode_name(mode), copy_mode_name(install_mode_));
+	}
+	if(server_) {
+		server_->invalidate(dst);
+	}
+	if(compressor_.wanted(dst)) {
+		compressor_.add_file(dst);
+	}
+	entry.mtime = mtime_ticks(get_mtime(dst));
+	record_output(action, dst, fs::file_size(src), entry.hash);
 
 	return src_mtime;
 }
 
 mtime_t App::create_file(std::string const& info, std::string const& data,
-	fs::path const& src, fs::path const& dst) {
+	fs::path const& src, fs::path const& dst, Entry& entry) {
+
+	auto prof = profiler_.step("write");
 
 	auto src_mtime = get_mtime(src);
 
+	entry.hash = hash(data);
+
 	if(!config_.rebuild && fs::exists(dst)) {
+		// output of interrupted run is written again, see update_file
+		auto cached = cache_.entry_output(entry);
 		auto dst_mtime = get_mtime(dst);
+		bool trusted = cached && cached->mtime == mtime_ticks(dst_mtime);
 
-		if(src_mtime > dst_mtime) {
-			LOG_INFO("UPDATE: {}\n", info);
-		} else {
+		// mtime is only cheap pre-filter, content hash decides
+		// (forced after templates or configuration changed)
+		if(trusted && config_.mtime_check && !force_ && src_mtime <= dst_mtime) {
+			return mtime_t::min();
+		}
+
+		if(trusted && entry.hash == cached->hash) {
+			// output stays, row is updated when index or feed part of
+			// entry changed (short_size, front matter not shown on page)
+			if(entry.excerpt != cached->excerpt ||
+				entry.read_more != cached->read_more ||
+				entry.meta != cached->meta) {
+				LOG_TRACE("UNCHANGED: {} (excerpt or meta updated)\n", info);
+				entry.mtime = cached->mtime;
+				return src_mtime;
+			}
+			LOG_TRACE("UNCHANGED: {}\n", info);
 			return mtime_t::min();
 		}
+
+		LOG_INFO("UPDATE: {}\n", info);
 	} else {
 		LOG_INFO("CREATE: {}\n", info);
 	}
 
 	fs::create_directories(dst.parent_path());
-	write_file(dst, data);
+	auto action = fs::exists(dst) ? "update" : "create";
+	write_output(dst, data);
+	entry.mtime = mtime_ticks(get_mtime(dst));
+	record_output(action, dst, data.size(), entry.hash);
 
 	return src_mtime;
 }
 
-void App::process_static() {
+void App::reconcile(std::vector<fs::path> const& statics,
+	std::vector<fs::path> const* sources) {
+
+	enum { ID, TYPE, SOURCE, PATH, SLUG, FILE_, OWNER };
+
+	auto prof = profiler_.phase("reconcile");
+
+	// sources found by walk of build(), nothing is checked on disk
+	auto relative = [](std::vector<fs::path> const& files, std::string const& dir) {
+		std::unordered_set<std::string> ret;
+		for(auto const& file : files) {
+			ret.insert(file.lexically_relative(dir).string());
+		}
+		return ret;
+	};
+	auto static_files = relative(statics, config_.static_dir);
+	std::unordered_set<std::string> source_files;
+	if(sources) {
+		source_files = relative(*sources, config_.source_dir);
+	}
+
+	std::vector<std::pair<sqlite3_int64, fs::path>> stale;
+	cache_.list_sources([&](QueryResult row) {
+		auto type = static_cast<Type>(row.int64(TYPE));
+		bool found;
+		if(type == Type::Static) {
+			found = static_files.count(std::string(row[SOURCE]));
+		} else if(!sources) {
+			return;
+		} else {
+			found = source_files.count(std::string(row[SOURCE]));
+			// attached file goes away with its markdown file
+			if(found && type == Type::File) {
+				found = !row[OWNER].empty() &&
+					source_files.count(std::string(row[OWNER]));
+			}
+		}
+		if(!found) {
+			stale.emplace_back(row.int64(ID),
+				fs::path(row[PATH]) / row[SLUG] / row[FILE_]);
+		}
+	});
+
+	for(auto const& [id, info] : stale) {
+		remove_output(id, info);
+	}
+}
+
+void App::remove_output(sqlite3_int64 id, fs::path const& info) {
+	LOG_INFO("REMOVE: {}\n", info);
+	cache_.remove_entry(id);
+	remove_path(fs::path(config_.destination_dir) / info);
+}
+
+void App::remove_path(fs::path const& dst) {
+	std::error_code ec;
+	if(fs::remove(dst, ec)) {
+		record_output("delete", dst, 0, "");
+	}
+	for(auto const& ext : Compressor::extensions()) {
+		auto sibling = dst;
+		sibling += ext;
+		if(fs::remove(sibling, ec)) {
+			record_output("delete", sibling, 0, "");
+		}
+	}
+	if(server_) {
+		server_->invalidate(dst);
+	}
+
+	// drop directories left empty (slug of renamed entry)
 	auto destination = fs::path(config_.destination_dir);
+	for(auto dir = dst.parent_path(); ; dir = dir.parent_path()) {
+		auto rel = dir.lexically_relative(destination);
+		if(rel.empty() || rel == "." || *rel.begin() == "..") {
+			break;
+		}
+		if(!fs::is_empty(dir, ec) || ec || !fs::remove(dir, ec)) {
+			break;
+		}
+	}
+}
 
-	for(auto const& p : fs::recursive_directory_iterator(config_.static_dir)) {
-		if(!p.is_regular_file()) {
-			continue;
+bool App::write_page(std::string const& info, std::string const& data,
+	fs::path const& dst, Entry& entry) {
+
+	auto prof = profiler_.step("write");
+
+	// stored hash of last output, file itself is not read
+	entry.hash = hash(data);
+
+	if(!config_.rebuild && fs::exists(dst)) {
+		auto cached = cache_.entry_output(entry);
+		if(cached && entry.hash == cached->hash) {
+			LOG_TRACE("UNCHANGED: {}\n", info);
+			return false;
 		}
 
-		auto path = p.path().lexically_relative(config_.static_dir);
-		auto file = destination / path;
+		LOG_INFO("UPDATE: {}\n", info);
+	} else {
+		LOG_INFO("CREATE: {}\n", info);
+	}
 
-		auto mtime = update_file(path, p.path(), file);
-		if(mtime != mtime_t::min()) {
-			auto sql_path = cache_.path_id(path.parent_path());
-			Entry entry;
-			entry.type = Type::Static;
-			entry.source = path;
-			entry.path = sql_path;
-			entry.slug = {};
-			entry.file = path.filename();
-			entry.title = {};
-			entry.created = format_mtime(mtime);
-			entry.update = false;
+	fs::create_directories(dst.parent_path());
+	auto action = fs::exists(dst) ? "update" : "create";
+	write_output(dst, data);
+	record_output(action, dst, data.size(), entry.hash);
 
-			cache_.add_entry(entry);
+	return true;
+}
+
+std::vector<fs::path> App::list_files(std::string const& dir) {
+	auto prof = profiler_.phase("list_files");
+
+	std::vector<fs::path> files;
+	for(auto const& p : fs::recursive_directory_iterator(dir)) {
+		if(p.is_regular_file()) {
+			files.push_back(p.path());
 		}
 	}
+
+	// sorted so cache ids and output order do not depend on directory order
+	std::sort(files.begin(), files.end());
+	return files;
 }
 
-void App::process_source() {
-	for(auto const& p : fs::recursive_directory_iterator(config_.source_dir)) {
-		if(!p.is_regular_file()) {
-			continue;
+void App::process_static(std::vector<fs::path> const& files) {
+	auto prof = profiler_.phase("process_static");
+
+	for(auto const& path : files) {
+		process_static_file(path);
+	}
+}
+
+void App::process_static_file(fs::path const& src_path) {
+	auto destination = fs::path(config_.destination_dir);
+
+	auto path = src_path.lexically_relative(config_.static_dir);
+	auto prof = profiler_.file("static", path.string());
+	auto file = destination / path;
+
+	Entry entry;
+	entry.type = Type::Static;
+	entry.source = path;
+	entry.path = cache_.path_id(path.parent_path());
+	entry.slug = {};
+	entry.file = path.filename();
+	entry.title = {};
+	entry.update = false;
+
+	auto mtime = update_file(path, src_path, file, entry);
+	if(mtime != mtime_t::min()) {
+		entry.created = format_mtime(mtime);
+
+		cache_.add_entry(entry);
+	}
+}
+
+void App::process_source(std::vector<fs::path> const& files) {
+	auto prof = profiler_.phase("process_source");
+
+	std::vector<fs::path> sources;
+	for(auto const& path : files) {
+		if(path.extension() == ".md") {
+			sources.push_back(path);
 		}
+	}
 
-		auto path = p.path();
-		if(path.extension() != ".md") {
-			continue;
+	if(config_.jobs <= 1 || sources.size() <= 1) {
+		for(auto const& path : sources) {
+			process_mkd(path);
+		}
+		return;
+	}
+
+	// reading, parsing and rendering is done by workers (each with own copy
+	// of templates), results are committed in order by this thread which is
+	// only one touching cache_ and output files
+	struct Templates {
+		tmpl::Template page;
+		tmpl::Template entry;
+	};
+	std::vector<Templates> tmpls(config_.jobs);
+	for(auto& t : tmpls) {
+		t.page.parse(page_src_);
+		t.entry.parse(entry_src_);
+	}
+
+	Pool pool(config_.jobs);
+
+	// limit number of rendered pages kept in memory
+	size_t const window = pool.size() * 4;
+	std::deque<std::future<Mkd>> pending;
+	size_t next = 0;
+
+	while(next < sources.size() || !pending.empty()) {
+		while(next < sources.size() && pending.size() < window) {
+			auto const& path = sources[next++];
+			pending.push_back(pool.submit([this, &tmpls, &path](unsigned worker) {
+				auto& t = tmpls[worker];
+				return render_mkd(path, t.page, t.entry);
+			}));
 		}
 
-		process_mkd(path);
+		auto mkd = pending.front().get();
+		pending.pop_front();
+		commit_mkd(mkd);
 	}
 }
 
 void App::process_mkd(fs::path const& src_path) {
-	auto destination = fs::path(config_.destination_dir);
+	commit_mkd(render_mkd(src_path, page_tmpl_, entry_tmpl_));
+}
+
+Mkd App::render_mkd(fs::path const& src_path,
+	tmpl::Template& page_tmpl, tmpl::Template& entry_tmpl) {
 
 	auto base_url = config_.cfg.get_value("base_url", "/");
 
-	std::string md = read_file(src_path.string());
+	auto prof = profiler_.file("render",
+		src_path.lexically_relative(config_.source_dir).string());
+	auto step = profiler_.step("read");
+
+	std::string const original = read_file(src_path.string());
+	std::string md = original;
 
+	step.next("front matter");
 	std::string const separator("---\n");
 	kvc::Config meta;
 	if(md.rfind(separator, 0) == 0) {
@@ -323,12 +890,15 @@ void App::process_mkd(fs::path const& src_path) {
 		}
 	}
 
+	step.next("parse");
 	mkd::Parser parser;
 	std::string html = parser.parse(md);
 
+	step.next("data");
+
 	auto type = meta.get_value("type", auto_page ? "page" : "entry");
 	bool is_page = type == "page";
-	tmpl::Template& tmpl = is_page ? page_tmpl_ : entry_tmpl_;
+	tmpl::Template& tmpl = is_page ? page_tmpl : entry_tmpl;
 
 	auto root = tmpl.data();
 	root->clear();
@@ -344,8 +914,6 @@ void App::process_mkd(fs::path const& src_path) {
 	meta.set("title", title);
 
 	auto base = path.parent_path() / slug;
-	auto info = base / "index.html";
-	auto dst = destination / info;
 
 	auto src_mtime = get_mtime(src_path);
 	auto src_datetime = format_mtime(src_mtime);
@@ -399,7 +967,7 @@ void App::process_mkd(fs::path const& src_path) {
 
 	auto entry_datetime = meta.get_value("created", src_datetime);
 
-	config2tmpl(config_.cfg, root);
+	site2tmpl(root);
 	config2tmpl(meta, root);
 	root->set("datetime", entry_datetime);
 	root->set("date", entry_datetime.substr(0, 10));
@@ -414,90 +982,209 @@ void App::process_mkd(fs::path const& src_path) {
 	}
 
 
-	// update .md file
-	write_file(src_path, separator + meta.to_string() + separator + md);
-	fs::last_write_time(src_path, src_mtime);
-
+	// excerpt for index and feed
+	step.next("excerpt");
+	std::string excerpt;
+	bool read_more = false;
+	if(!is_page) {
+		int short_size = std::stoi(config_.cfg.get_value("short_size", "200"));
 
-	// create index.html from .md
-	auto md_mtime = create_file(info, tmpl.make(), src_path, dst);
-	if(md_mtime != mtime_t::min()) {
-		auto sql_path = cache_.path_id(base.parent_path());
-		Entry entry;
-		entry.type = is_page ? Type::Page : Type::Entry;
-		entry.source = path;
-		entry.path = sql_path;
-		entry.slug = slug;
-		entry.file = "index.html";
-		entry.title = title;
-		entry.created = meta.get_value("created", src_datetime);
-		entry.updated = meta.get_value("updated", src_datetime);
-		entry.update = updated;
-
-		auto entry_id = cache_.add_entry(entry);
-
-		if(!is_page) {
-			auto path = base.parent_path();
-			while(!path.empty()) {
-				paths_.insert(path);
-				path = path.parent_path();
-			}
-			if(tags && tags->is_array) {
-				for(auto const& tag : tags->values) {
-					cache_.add_tag(entry_id, tag);
-					tags_.insert(tag);
+		auto short_md = md;
+		auto pos = short_md.find("<!-- cut -->");
+		if(pos != std::string::npos) {
+			short_md = short_md.substr(0, pos);
+		} else {
+			pos = short_md.find('\n', static_cast<size_t>(short_size));
+			while(pos != std::string::npos) {
+				if(short_md[pos+1] == '\r' || short_md[pos+1] == '\n') {
+					short_md = short_md.substr(0, pos);
+					break;
 				}
+				pos = short_md.find('\n', pos+1);
+			}
+			pos = short_md.find("\n```");
+			if(pos != std::string::npos) {
+				short_md = short_md.substr(0, pos);
 			}
+			pos = short_md.find("\n    ");
+			if(pos != std::string::npos) {
+				short_md = short_md.substr(0, pos);
+			}
+		}
+
+		mkd::Parser short_parser;
+		excerpt = short_parser.parse(short_md);
+		read_more = short_md.size() < md.size();
+	}
+
+	// update .md file only when normalized front matter differs
+	step.next("writeback");
+	if(config_.writeback) {
+		auto normalized = separator + meta.to_string() + separator + md;
+		if(normalized != original) {
+			replace_file(src_path, normalized, src_mtime);
 		}
 	}
 
+
+	step.next("make");
+	Mkd mkd;
+	mkd.src_path = src_path;
+	mkd.path = path;
+	mkd.base = base;
+	mkd.slug = slug;
+	mkd.title = title;
+	mkd.is_page = is_page;
+	mkd.created = meta.get_value("created", src_datetime);
+	mkd.updated = meta.get_value("updated", src_datetime);
+	mkd.update = updated;
+	mkd.html = tmpl.make();
+	mkd.excerpt = excerpt;
+	mkd.read_more = read_more;
+	mkd.meta = meta.to_string();
+	if(tags && tags->is_array) {
+		mkd.tags = tags->values;
+	}
 	for(auto const& code : parser.codes()) {
 		auto [file, data] = code;
+		mkd.codes.emplace_back(file, data);
+	}
+	if(meta_files) {
+		mkd.files = meta_files->values;
+	}
+	step.stop();
+
+	return mkd;
+}
+
+void App::commit_mkd(Mkd const& mkd) {
+	auto destination = fs::path(config_.destination_dir);
+
+	auto const& src_path = mkd.src_path;
+	auto const& path = mkd.path;
+	auto const& base = mkd.base;
+	auto const& slug = mkd.slug;
+
+	auto info = base / "index.html";
+	auto dst = destination / info;
+
+	auto prof = profiler_.file("commit", path.string());
+
+	// all rows of one source are written together
+	cache_.begin("mkd");
+
+	auto sql_path = cache_.path_id(base.parent_path());
+
+	// create index.html from .md
+	Entry entry;
+	entry.type = mkd.is_page ? Type::Page : Type::Entry;
+	entry.source = path;
+	entry.path = sql_path;
+	entry.slug = slug;
+	entry.file = "index.html";
+	entry.title = mkd.title;
+	entry.created = mkd.created;
+	entry.updated = mkd.updated;
+	entry.update = mkd.update;
+	entry.excerpt = mkd.excerpt;
+	entry.read_more = mkd.read_more;
+	entry.meta = mkd.meta;
+
+	// rows of written outputs, added to cache together
+	std::vector<Entry> rows;
+
+	auto md_mtime = create_file(info, mkd.html, src_path, dst, entry);
+	if(md_mtime != mtime_t::min()) {
+		rows.push_back(std::move(entry));
+	}
+
+	for(auto const& code : mkd.codes) {
+		auto const& [file, data] = code;
 		auto finfo = base / file;
 		auto fpath = destination / finfo;
 
-		auto code_mtime = create_file(finfo, data, src_path, fpath);
+		Entry entry;
+		entry.type = Type::Source;
+		entry.source = path;
+		entry.path = sql_path;
+		entry.slug = slug;
+		entry.file = file;
+		entry.title = {};
+		entry.update = false;
+
+		auto code_mtime = create_file(finfo, data, src_path, fpath, entry);
 		if(code_mtime != mtime_t::min()) {
-			auto sql_path = cache_.path_id(base.parent_path());
-			Entry entry;
-			entry.type = Type::Source;
-			entry.source = path;
-			entry.path = sql_path;
-			entry.slug = slug;
-			entry.file = file;
-			entry.title = {};
 			entry.created = format_mtime(code_mtime);
-			entry.update = false;
-
-			cache_.add_entry(entry);
+			rows.push_back(std::move(entry));
 		}
 	}
 
 
-	if(meta_files && meta_files->values.size()) {
+	if(mkd.files.size()) {
 		auto src_dir = src_path.parent_path();
-		for(auto const& file : meta_files->values) {
+		for(auto const& file : mkd.files) {
 			auto src_file = src_dir / file;
 			auto finfo = base / file;
 			auto dst_file = destination / finfo;
 
-			auto file_mtime = update_file(finfo, src_file, dst_file);
+			Entry entry;
+			entry.type = Type::File;
+			entry.source = src_file.lexically_relative(config_.source_dir);
+			entry.path = sql_path;
+			entry.slug = slug;
+			entry.file = file;
+			entry.title = {};
+			entry.update = false;
+
+			auto file_mtime = update_file(finfo, src_file, dst_file, entry);
 			if(file_mtime != mtime_t::min()) {
-				auto sql_path = cache_.path_id(base.parent_path());
-				Entry entry;
-				entry.type = Type::File;
-				entry.source = src_file.lexically_relative(config_.source_dir);
-				entry.path = sql_path;
-				entry.slug = slug;
-				entry.file = file;
-				entry.title = {};
 				entry.created = format_mtime(file_mtime);
-				entry.update = false;
+				rows.push_back(std::move(entry));
+			}
+		}
+	}
 
-				cache_.add_entry(entry);
+	if(!rows.empty()) {
+		auto sql = profiler_.step("sql");
+		auto ids = cache_.add_entries(std::move(rows));
+
+		if(md_mtime != mtime_t::min() && !mkd.is_page) {
+			cache_.set_tags(ids.front(), mkd.tags);
+		}
+	}
+
+	// outputs of previous slug and removed code blocks or attachments
+	if(md_mtime != mtime_t::min()) {
+		enum { ID, PATH_ID, PATH, SLUG, FILE_ };
+
+		std::unordered_set<std::string> outputs = {"index.html"};
+		for(auto const& code : mkd.codes) {
+			outputs.insert(code.first);
+		}
+		outputs.insert(mkd.files.begin(), mkd.files.end());
+
+		std::vector<std::pair<sqlite3_int64, fs::path>> stale;
+		cache_.list_source_outputs(path.string(), [&](QueryResult row) {
+			if(row.int64(PATH_ID) != sql_path || row[SLUG] != slug ||
+				!outputs.count(std::string(row[FILE_]))) {
+				stale.emplace_back(row.int64(ID),
+					fs::path(row[PATH]) / row[SLUG] / row[FILE_]);
 			}
+		});
+
+		for(auto const& [id, info] : stale) {
+			remove_output(id, info);
 		}
 	}
+
+	auto sql = profiler_.step("sql");
+	cache_.commit();
+}
+
+void App::site2tmpl(tmpl::Data::Value* root) {
+	for(auto const& [key, value] : config_.site) {
+		root->set(key, value);
+	}
 }
 
 void App::config2tmpl(kvc::Config& conf, tmpl::Data::Value* root) {
@@ -516,147 +1203,337 @@ void App::process_paths() {
 		return;
 	}
 
-	auto root = list_tmpl_.data();
+	auto prof = profiler_.phase("process_paths");
 
 	auto destination = fs::path(config_.destination_dir);
 	auto base_url = config_.cfg.get_value("base_url", "/");
 
+	// ids are looked up by this thread, path_id() waits for writer
+	std::vector<std::pair<std::string, sqlite3_int64>> paths;
 	for(auto const& path : paths_) {
 		// skip / as there is index.html from process_index
-		if(path.empty()) {
+		// and tags which are done by process_tags
+		if(path.empty() || path == "tags" || path.rfind("tags/", 0) == 0) {
 			continue;
 		}
+		paths.emplace_back(path, cache_.path_id(path));
+	}
 
+	auto render_path = [&](tmpl::Template& list_tmpl, std::string const& path,
+		sqlite3_int64 path_id) {
+
+		auto render = profiler_.file("render", fmt::format("{}/index.html", path));
+
+		auto root = list_tmpl.data();
 		root->clear();
-		config2tmpl(config_.cfg, root);
+		site2tmpl(root);
 		root->set("title", path);
 
-		auto path_id = cache_.path_id(path);
-
 		auto block_list = root->block("list");
 		cache_.list_subpaths(path_id, [&](QueryResult paths) {
 			auto& p = block_list->add();
-			p.set("url", base_url + paths[PATH] + "/");
-			p.set("name", paths[NAME]);
+			p.set("url", fmt::format("{}{}/", base_url, paths[PATH]));
+			p.set("name", std::string(paths[NAME]));
 		});
 
 		auto block_entries = root->block("entries");
 		cache_.list_entries_path(path_id, [&](QueryResult entry) {
 			auto& e = block_entries->add();
-			e.set("datetime", entry[DATETIME]);
-			e.set("date", entry[DATETIME].substr(0, 10));
-			e.set("title", entry[TITLE]);
-			std::string path_slash = entry[PATH].empty() ? "" : entry[PATH] + "/";
-			e.set("url", base_url + path_slash + entry[SLUG] + "/");
+			e.set("datetime", std::string(entry[DATETIME]));
+			e.set("date", std::string(entry[DATETIME].substr(0, 10)));
+			e.set("title", std::string(entry[TITLE]));
+			e.set("url", entry_url(base_url, entry[PATH], entry[SLUG]));
 		});
 
-		LOG_INFO("CREATE: {}/index.html\n", path);
-		auto dst = destination / path;
-		fs::create_directories(dst);
-		write_file(dst / "index.html", list_tmpl_.make());
-		
-		auto sql_path = cache_.path_id(path);
+		return list_tmpl.make();
+	};
+
+	auto write_path = [&](std::string const& path, sqlite3_int64 path_id,
+		std::string const& data) {
+
 		Entry entry;
 		entry.type = Type::List;
 		entry.source = "";
-		entry.path = sql_path;
+		entry.path = path_id;
 		entry.slug = {};
 		entry.file = "index.html";
 		entry.title = {};
 		entry.created = config_.cfg.get_value("now", "now");
 		entry.update = false;
 
-		cache_.add_entry(entry);
+		auto dst = destination / path / "index.html";
+		auto info = fmt::format("{}/index.html", path);
+		if(write_page(info, data, dst, entry)) {
+			cache_.add_entry(entry);
+		}
+	};
+
+	// workers query from read-only connections of cache, which do not see
+	// rows of open transaction, but lists read only rows committed by
+	// previous phases; without WAL they would wait for this thread
+	if(config_.jobs <= 1 || paths.size() <= 1 || !cache_.parallel_reads()) {
+		for(auto const& [path, path_id] : paths) {
+			write_path(path, path_id, render_path(list_tmpl_, path, path_id));
+		}
+		return;
+	}
+
+	std::vector<tmpl::Template> tmpls(config_.jobs);
+	for(auto& t : tmpls) {
+		t.parse(list_src_);
+	}
+	Pool pool(config_.jobs);
+
+	// limit number of rendered pages kept in memory
+	size_t const window = pool.size() * 4;
+	std::deque<std::future<std::string>> pending;
+	size_t next = 0;
+	size_t done = 0;
+
+	while(done < paths.size()) {
+		while(next < paths.size() && pending.size() < window) {
+			auto const& [path, path_id] = paths[next++];
+			pending.push_back(pool.submit(
+				[&render_path, &tmpls, &path = path, path_id = path_id](unsigned worker) {
+				return render_path(tmpls[worker], path, path_id);
+			}));
+		}
+
+		auto const& [path, path_id] = paths[done++];
+		auto data = pending.front().get();
+		pending.pop_front();
+		write_path(path, path_id, data);
 	}
 }
 
 void App::process_tags() {
 	enum { NAME };
-	enum { PATH, SLUG, FILE_, TITLE, DATETIME };
+	enum { TAG, PATH, SLUG, FILE_, TITLE, DATETIME };
 
-	if(tags_.empty()) {
+	if(tags_.empty() && !paths_.count("tags")) {
 		return;
 	}
 
+	auto prof = profiler_.phase("process_tags");
+
 	auto root = list_tmpl_.data();
 
 	auto destination = fs::path(config_.destination_dir);
 	auto base_url = config_.cfg.get_value("base_url", "/");
 
-	root->clear();
-	config2tmpl(config_.cfg, root);
-	root->set("title", config_.cfg.get("tags_name")->value);
-
-	auto block_list = root->block("list");
-	cache_.list_tags([&](QueryResult tag) {
-		auto& p = block_list->add();
-		p.set("url", base_url + "tags/" + tag[NAME] + "/");
-		p.set("name", tag[NAME]);
-	});
-
-	LOG_INFO("CREATE: tags/index.html\n");
-	auto dst = destination / "tags";
-	fs::create_directories(dst);
-	write_file(dst / "index.html", list_tmpl_.make());
-
-	auto sql_path = cache_.path_id("tags");
-	Entry entry;
-	entry.type = Type::List;
-	entry.source = "";
-	entry.path = sql_path;
-	entry.slug = {};
-	entry.file = "index.html";
-	entry.title = {};
-	entry.created = config_.cfg.get_value("now", "now");
-	entry.update = false;
+	// list of tags changes only when new tag shows up
+	if(paths_.count("tags")) {
+		root->clear();
+		site2tmpl(root);
+		root->set("title", config_.cfg.get("tags_name")->value);
 
-	cache_.add_entry(entry);
+		auto block_list = root->block("list");
+		cache_.list_tags([&](QueryResult tag) {
+			auto& p = block_list->add();
+			p.set("url", fmt::format("{}tags/{}/", base_url, tag[NAME]));
+			p.set("name", std::string(tag[NAME]));
+		});
 
-	for(auto const& tag : tags_) {
-		root->clear();
-		config2tmpl(config_.cfg, root);
-		root->set("title", config_.cfg.get("tags_name")->value + ": " + tag);
+		auto sql_path = cache_.path_id("tags");
+		Entry entry;
+		entry.type = Type::List;
+		entry.source = "";
+		entry.path = sql_path;
+		entry.slug = {};
+		entry.file = "index.html";
+		entry.title = {};
+		entry.created = config_.cfg.get_value("now", "now");
+		entry.update = false;
 
-		auto tag_id = cache_.tag_id(tag);
+		auto dst = destination / "tags" / "index.html";
+		if(write_page("tags/index.html", list_tmpl_.make(), dst, entry)) {
+			cache_.add_entry(entry);
+		}
+	}
 
-		auto block_entries = root->block("entries");
-		cache_.list_entries_tag(tag_id, [&](QueryResult entry) {
-			auto& e = block_entries->add();
-			e.set("datetime", entry[DATETIME]);
-			e.set("date", entry[DATETIME].substr(0, 10));
-			e.set("title", entry[TITLE]);
-			std::string path_slash = entry[PATH].empty() ? "" : entry[PATH] + "/";
-			e.set("url", base_url + path_slash + entry[SLUG] + "/");
-		});
+	if(tags_.empty()) {
+		return;
+	}
 
-		LOG_INFO("CREATE: tags/{}/index.html\n", tag);
-		auto dst = destination / "tags" / tag;
-		fs::create_directories(dst);
-		write_file(dst / "index.html", list_tmpl_.make());
-		
+	// pages are written while query of entries still runs on same
+	// connection, so nothing is written to cache meanwhile: ids of tag
+	// paths are looked up before it and rows of written pages are added
+	// after it
+	std::unordered_map<std::string, sqlite3_int64> tag_paths;
+	for(auto const& tag : tags_) {
+		tag_paths.emplace(tag, cache_.path_id(fmt::format("tags/{}", tag)));
+	}
+	std::vector<Entry> rows;
 
-		auto sql_path = cache_.path_id(fmt::format("tags/{}", tag));
+	auto write_tag = [&](std::string const& tag, std::string const& data) {
 		Entry entry;
 		entry.type = Type::List;
 		entry.source = "";
-		entry.path = sql_path;
+		entry.path = tag_paths.at(tag);
 		entry.slug = {};
 		entry.file = "index.html";
 		entry.title = {};
 		entry.created = config_.cfg.get_value("now", "now");
 		entry.update = false;
 
-		cache_.add_entry(entry);
+		auto dst = destination / "tags" / tag / "index.html";
+		auto info = fmt::format("tags/{}/index.html", tag);
+		if(write_page(info, data, dst, entry)) {
+			rows.push_back(std::move(entry));
+		}
+	};
+
+	// page of tag is filled entry by entry, returns block of entries
+	auto begin_tag = [this](tmpl::Template& list_tmpl, std::string const& tag) {
+		auto root = list_tmpl.data();
+		root->clear();
+		site2tmpl(root);
+		root->set("title", config_.cfg.get_value("tags_name", "") + ": " + tag);
+		return root->block("entries");
+	};
+	auto add_entry = [&base_url](auto block, std::string_view path,
+		std::string_view slug, std::string_view title, std::string_view datetime) {
+
+		auto& e = block->add();
+		e.set("datetime", std::string(datetime));
+		e.set("date", std::string(datetime.substr(0, 10)));
+		e.set("title", std::string(title));
+		e.set("url", entry_url(base_url, path, slug));
+	};
+
+	// entries of all dirty tags come from one query ordered by tag (entries
+	// of each tag are sorted when query gets to it), page of tag is
+	// written when rows of next tag start
+	std::unordered_set<std::string> done;
+	std::string current;
+
+	if(config_.jobs <= 1 || tags_.size() <= 1) {
+		// rows go straight into list template, page is made when rows of
+		// next tag start
+		decltype(begin_tag(list_tmpl_, current)) block = nullptr;
+		auto finish = [&]() {
+			std::string data;
+			{
+				auto render = profiler_.file("render",
+					fmt::format("tags/{}/index.html", current));
+				data = list_tmpl_.make();
+			}
+			write_tag(current, data);
+			done.insert(current);
+		};
+
+		cache_.list_dirty_tag_entries([&](QueryResult row) {
+			if(!block || row[TAG] != current) {
+				if(block) {
+					finish();
+				}
+				current = row[TAG];
+				block = begin_tag(list_tmpl_, current);
+			}
+			add_entry(block, row[PATH], row[SLUG], row[TITLE], row[DATETIME]);
+		});
+		if(block) {
+			finish();
+		}
+
+		// tags without entries (e.g. only on pages) still get empty page
+		for(auto const& tag : tags_) {
+			if(!done.count(tag)) {
+				current = tag;
+				begin_tag(list_tmpl_, current);
+				finish();
+			}
+		}
+
+		if(!rows.empty()) {
+			cache_.add_entries(std::move(rows));
+		}
+		return;
+	}
+
+	// rows of each tag are copied (only columns shown) for worker which
+	// renders page with own copy of list template, pages are written in
+	// order by this thread
+	std::vector<tmpl::Template> tmpls(config_.jobs);
+	for(auto& t : tmpls) {
+		t.parse(list_src_);
+	}
+	Pool pool(config_.jobs);
+
+	struct TagEntry {
+		std::string path;
+		std::string slug;
+		std::string title;
+		std::string datetime;
+	};
+	std::vector<TagEntry> group;
+
+	// limit number of rendered pages kept in memory
+	size_t const window = pool.size() * 4;
+	std::deque<std::pair<std::string, std::future<std::string>>> pages;
+
+	auto write_front = [&]() {
+		auto tag = std::move(pages.front().first);
+		auto data = pages.front().second.get();
+		pages.pop_front();
+		write_tag(tag, data);
+	};
+
+	auto submit = [&](std::string const& tag) {
+		done.insert(tag);
+		pages.emplace_back(tag, pool.submit(
+			[&, tag, entries = std::move(group)](unsigned worker) {
+			auto render = profiler_.file("render",
+				fmt::format("tags/{}/index.html", tag));
+			auto& t = tmpls[worker];
+			auto block = begin_tag(t, tag);
+			for(auto const& e : entries) {
+				add_entry(block, e.path, e.slug, e.title, e.datetime);
+			}
+			return t.make();
+		}));
+		group = {};
+		while(pages.size() >= window) {
+			write_front();
+		}
+	};
+
+	cache_.list_dirty_tag_entries([&](QueryResult row) {
+		if(!group.empty() && row[TAG] != current) {
+			submit(current);
+		}
+		current = row[TAG];
+		group.push_back({std::string(row[PATH]), std::string(row[SLUG]),
+			std::string(row[TITLE]), std::string(row[DATETIME])});
+	});
+	if(!group.empty()) {
+		submit(current);
+	}
+
+	for(auto const& tag : tags_) {
+		if(!done.count(tag)) {
+			submit(tag);
+		}
+	}
+
+	while(!pages.empty()) {
+		write_front();
+	}
+
+	if(!rows.empty()) {
+		cache_.add_entries(std::move(rows));
 	}
 }
 
 void App::process_index() {
-	enum { PATH, SLUG, FILE_, TITLE, DATETIME, UPDATED, SOURCE };
+	enum { PATH, SLUG, FILE_, TITLE, DATETIME, UPDATED, EXCERPT, READ_MORE, META };
 
-	if(paths_.empty()) {
+	if(!paths_.count("")) {
 		return;
 	}
 
+	auto prof = profiler_.phase("process_index");
+
 	auto root = index_tmpl_.data();
 	auto feed = feed_tmpl_.data();
 
@@ -671,11 +1548,11 @@ void App::process_index() {
 	);
 
 	root->clear();
-	config2tmpl(config_.cfg, root);
+	site2tmpl(root);
 	root->set("title", title);
 
 	feed->clear();
-	config2tmpl(config_.cfg, feed);
+	site2tmpl(feed);
 	feed->set("title", title);
 	bool is_first = true;
 	feed->set("feed_url", feed_base_url + "feed.xml");
@@ -683,70 +1560,33 @@ void App::process_index() {
 	feed->set("id", feed_base_url);
 
 	int num_entries = std::stoi(config_.cfg.get_value("num_entries", "5"));
-	int short_size = std::stoi(config_.cfg.get_value("short_size", "200"));
 
 	auto block_entries = root->block("entries");
 	auto feed_entries = feed->block("entries");
 	cache_.last_entries(num_entries, [&](QueryResult entry) {
+		// columns used by both index and feed
+		std::string datetime(entry[DATETIME]);
+		std::string updated(entry[UPDATED]);
+		std::string title(entry[TITLE]);
+		std::string short_html(entry[EXCERPT]);
+
 		if(is_first) {
-			feed->set("updated",
-				entry[UPDATED].empty() ? entry[DATETIME] : entry[UPDATED]
-			);
+			feed->set("updated", updated.empty() ? datetime : updated);
 			is_first = false;
 		}
 
-		auto src_path = fs::path(config_.source_dir) / entry[SOURCE];
-		std::string md = read_file(src_path.string());
-
-		std::string const separator("---\n");
 		kvc::Config meta;
-		if(md.rfind(separator, 0) == 0) {
-			auto pos = md.find(separator, separator.size());
-			auto const len = separator.size();
-			if(pos != std::string::npos) {
-				meta.parse(md.substr(len, pos-len));
-				md = md.substr(pos+len);
-			}
-		}
-
-		auto md_size = md.size();
-
-		mkd::Parser parser;
-		std::string html = parser.parse(md);
-
-		auto pos = md.find("<!-- cut -->");
-		if(pos != std::string::npos) {
-			md = md.substr(0, pos);
-		} else {
-			pos = md.find('\n', short_size);
-			while(pos != std::string::npos) {
-				if(md[pos+1] == '\r' || md[pos+1] == '\n') {
-					md = md.substr(0, pos);
-					break;
-				}
-				pos = md.find('\n', pos+1);
-			}
-			pos = md.find("\n```");
-			if(pos != std::string::npos) {
-				md = md.substr(0, pos);
-			}
-			pos = md.find("\n    ");
-			if(pos != std::string::npos) {
-				md = md.substr(0, pos);
-			}
-		}
-		std::string short_html = parser.parse(md);
+		meta.parse(std::string(entry[META]));
 
 		auto& e = block_entries->add();
 		config2tmpl(meta, &e);
-		e.set("datetime", entry[DATETIME]);
-		e.set("date", entry[DATETIME].substr(0, 10));
-		e.set("title", entry[TITLE]);
-		std::string path_slash = entry[PATH].empty() ? "" : entry[PATH] + "/";
-		e.set("url", base_url + path_slash + entry[SLUG] + "/");
+		e.set("datetime", datetime);
+		e.set("date", datetime.substr(0, 10));
+		e.set("title", title);
+		e.set("url", entry_url(base_url, entry[PATH], entry[SLUG]));
 		e.set("content", short_html);
 
-		if(md.size() < md_size) {
+		if(entry[READ_MORE] == "1") {
 			e.set("read_more", "");
 		}
 
@@ -761,30 +1601,26 @@ void App::process_index() {
 			}
 		}
 
+		auto feed_url = entry_url(feed_base_url, entry[PATH], entry[SLUG]);
 		auto& fe = feed_entries->add();
-		fe.set("title", entry[TITLE]);
-		fe.set("url", feed_base_url + path_slash + entry[SLUG] + "/");
-		fe.set("datetime", entry[DATETIME]);
+		fe.set("title", title);
+		fe.set("url", feed_url);
+		fe.set("datetime", datetime);
 		fe.set("content", short_html);
-		fe.set("id", feed_base_url + path_slash + entry[SLUG] + "/");
+		fe.set("id", feed_url);
 
-		if(!entry[UPDATED].empty()) {
+		if(!updated.empty()) {
 			e.set("is_updated", "");
-			e.set("updated_datetime", entry[UPDATED]);
-			e.set("updated_date", entry[UPDATED].substr(0, 10));
+			e.set("updated_datetime", updated);
+			e.set("updated_date", updated.substr(0, 10));
 
-			fe.set("updated_datetime", entry[UPDATED]);
+			fe.set("updated_datetime", updated);
 		} else {
-			fe.set("updated_datetime", entry[DATETIME]);
+			fe.set("updated_datetime", datetime);
 		}
 	});
 
 	{
-		LOG_INFO("CREATE: index.html\n");
-		auto dst = destination;
-		fs::create_directories(dst);
-		write_file(dst / "index.html", index_tmpl_.make());
-
 		auto sql_path = cache_.path_id("");
 		Entry entry;
 		entry.type = Type::Index;
@@ -796,15 +1632,13 @@ void App::process_index() {
 		entry.created = config_.cfg.get_value("now", "now");
 		entry.update = false;
 
-		cache_.add_entry(entry);
+		auto dst = destination / "index.html";
+		if(write_page("index.html", index_tmpl_.make(), dst, entry)) {
+			cache_.add_entry(entry);
+		}
 	}
 
 	{
-		LOG_INFO("CREATE: feed.xml\n");
-		auto dst = destination;
-		fs::create_directories(dst);
-		write_file(dst / "feed.xml", feed_tmpl_.make());
-
 		auto sql_path = cache_.path_id("");
 		Entry entry;
 		entry.type = Type::Feed;
@@ -816,7 +1650,10 @@ void App::process_index() {
 		entry.created = config_.cfg.get_value("now", "now");
 		entry.update = false;
 
-		cache_.add_entry(entry);
+		auto dst = destination / "feed.xml";
+		if(write_page("feed.xml", feed_tmpl_.make(), dst, entry)) {
+			cache_.add_entry(entry);
+		}
 	}
 }
 
@@ -1,13 +1,20 @@
 #ifndef HEADER_APP_HPP
 #define HEADER_APP_HPP
 
+#include <memory>
 #include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <tmpl/tmpl.hpp>
 
 #include "config.hpp"
 #include "cache.hpp"
+#include "server.hpp"
+#include "compress.hpp"
+#include "profile.hpp"
 
 #include "filesystem.hpp"
 
@@ -15,6 +22,39 @@ namespace miu {
 
 using mtime_t = decltype(fs::last_write_time(""));
 
+// markdown file rendered by worker thread, waiting to be written and cached
+struct Mkd {
+	fs::path src_path;
+	fs::path path;
+	fs::path base;
+
+	std::string slug;
+	std::string title;
+	bool is_page;
+
+	std::string created;
+	std::string updated;
+	bool update;
+
+	std::string html;
+	std::string excerpt;
+	bool read_more;
+	std::string meta;
+	std::vector<std::string> tags;
+	std::vector<std::pair<std::string, std::string>> codes;
+	std::vector<std::string> files;
+};
+
+// file written to destination directory, line of manifest
+struct Output {
+	const char* action;
+	std::string path;
+	uintmax_t size;
+	// content hash ("<mode>:<size>-<mtime>" of linked or reflinked
+	// static files, see file_key())
+	std::string hash;
+};
+
 class App {
 	public:
 		App(int argc, char** argv);
@@ -22,30 +62,88 @@ class App {
 
 		int run();
 	private:
+		int argc_;
+		char** argv_;
 		Config config_;
 		Cache cache_;
+		// static_mode files are installed with, downgraded when filesystem
+		// does not support configured one
+		CopyMode install_mode_;
 		tmpl::Template index_tmpl_;
 		tmpl::Template list_tmpl_;
 		tmpl::Template page_tmpl_;
 		tmpl::Template entry_tmpl_;
 		tmpl::Template feed_tmpl_;
+		std::string page_src_;
+		std::string entry_src_;
+		std::string list_src_;
+		// templates and configuration file of last load_templates(),
+		// kept in cache to find changes between runs
+		std::string templates_hash_;
 		std::unordered_set<std::string> paths_;
 		std::unordered_set<std::string> tags_;
+		// ignore mtimes of outputs, set when templates or config changed
+		bool force_ = false;
+		// preview server, outputs written by build are published to it
+		std::unique_ptr<Server> server_;
+		std::vector<Output> outputs_;
+		Compressor compressor_;
+		Profiler profiler_;
+
+		// partial templates by name, read once per load_templates()
+		using Partials = std::unordered_map<std::string, std::string>;
+
+		// all phases of one run, each in own transaction
+		void build();
+		void load_templates();
+		std::string expand_includes(std::string const& src, Partials& partials,
+			std::unordered_set<std::string>& included, int depth);
+
+		void write_output(fs::path const& path, std::string const& data);
+		void record_output(const char* action, fs::path const& path,
+			uintmax_t size, std::string const& hash);
+		void write_manifest();
 
 		std::string init_tmpl(std::string const& path, const char* default_);
 
+		// both return mtime of source when row of entry has to be added
+		// (output was written or row is outdated), mtime_t::min() otherwise
 		mtime_t update_file(std::string const& info,
-			fs::path const& src, fs::path const& dst);
+			fs::path const& src, fs::path const& dst, Entry& entry);
 		mtime_t create_file(std::string const& info, std::string const& data,
-			fs::path const& src, fs::path const& dst);
+			fs::path const& src, fs::path const& dst, Entry& entry);
+		// aggregate page, written only when different from last output
+		bool write_page(std::string const& info, std::string const& data,
+			fs::path const& dst, Entry& entry);
+
+		// removes outputs of static files not in statics and of sources not
+		// in sources (nullptr when source directory was not walked)
+		void reconcile(std::vector<fs::path> const& statics,
+			std::vector<fs::path> const* sources);
+		// outputs of file deleted while watching, false if it had none
+		bool remove_source(fs::path const& path);
+		void remove_output(sqlite3_int64 id, fs::path const& info);
+		void remove_path(fs::path const& dst);
 
-		void process_static();
-		void process_source();
+		// regular files in directory and its subdirectories, sorted
+		std::vector<fs::path> list_files(std::string const& dir);
+		void process_static(std::vector<fs::path> const& files);
+		void process_static_file(fs::path const& src_path);
+		// markdown files of files
+		void process_source(std::vector<fs::path> const& files);
 		void process_mkd(fs::path const& src_path);
+		Mkd render_mkd(fs::path const& src_path,
+			tmpl::Template& page_tmpl, tmpl::Template& entry_tmpl);
+		void commit_mkd(Mkd const& mkd);
 		void process_paths();
 		void process_tags();
 		void process_index();
+		void process_pages();
+
+		int watch();
+		void process_changes(std::vector<fs::path> const& changed);
 
+		void site2tmpl(tmpl::Data::Value* root);
 		void config2tmpl(kvc::Config& conf, tmpl::Data::Value* root);
 };
 
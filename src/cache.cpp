@@ -1,12 +1,22 @@
 #include "cache.hpp"
 
+#include <cctype>
+#include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 
 #include <fmt/core.h>
 
+// bump when db.sql changes, cache with other version is recreated
+static const int SCHEMA_VERSION = 7;
 
 Cache::Cache(std::string path) {
-	open(path);
+	try {
+		open(path);
+	} catch(...) {
+		close();
+		throw;
+	}
 }
 
 Cache::~Cache() {
@@ -17,24 +27,30 @@ Cache::~Cache() {
 bool Cache::open(std::string path) {
 	path_ = path;
 
-	int rc = sqlite3_open_v2(path.c_str(), &db_, SQLITE_OPEN_READWRITE, nullptr);
+	int rc = sqlite3_open_v2(path.c_str(), &writer_.db, SQLITE_OPEN_READWRITE, nullptr);
 	if(rc == SQLITE_OK) {
-		created_ = false;
-		sqlite3_extended_result_codes(db_, 1);
-		return true;
-	}
+		sqlite3_extended_result_codes(writer_.db, 1);
+		if(schema_version() == SCHEMA_VERSION) {
+			created_ = false;
+			wal_ = current_journal_mode() == "wal";
+			load_ids();
+			return true;
+		}
 
-	if(rc != SQLITE_CANTOPEN) {
-		err_exit("open", rc);
-		return false;
+		// cache made by other version of miu, start from scratch
+		sqlite3_close(writer_.db);
+		writer_.db = nullptr;
+		std::remove(path.c_str());
+	} else if(rc != SQLITE_CANTOPEN) {
+		throw_error("open", rc);
 	}
 
-	rc = sqlite3_open_v2(path.c_str(), &db_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+	rc = sqlite3_open_v2(path.c_str(), &writer_.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
 	if(rc == SQLITE_OK) {
-		sqlite3_extended_result_codes(db_, 1);
+		sqlite3_extended_result_codes(writer_.db, 1);
 
 #ifdef LOG_SQL
-		sqlite3_trace_v2(db_, SQLITE_TRACE_STMT,
+		sqlite3_trace_v2(writer_.db, SQLITE_TRACE_STMT,
 			[](unsigned, void* c, void* p, void*) -> int {
 			Cache* cache = (Cache*)c;
 			if(cache->log_sql()) {
@@ -49,27 +65,45 @@ bool Cache::open(std::string path) {
 		return create();
 	}
 
-	err_exit("open(create)", rc);
-	//close();
-	return false;
+	throw_error("open(create)", rc);
+}
+
+void Cache::close_conn(Conn& conn) {
+	for(auto& [sql, stmt] : conn.stmts) {
+		sqlite3_finalize(stmt);
+	}
+	conn.stmts.clear();
+
+	if(conn.db) {
+		sqlite3_close(conn.db);
+	}
+	conn.db = nullptr;
 }
 
 void Cache::close() {
-	if(db_) {
-		sqlite3_close(db_);
+	{
+		std::lock_guard<std::mutex> lock(readers_mutex_);
+		for(auto& reader : readers_) {
+			close_conn(*reader);
+		}
+		readers_.clear();
+		free_readers_.clear();
 	}
 
+	close_conn(writer_);
+	savepoints_.clear();
+	pending_ = 0;
+	new_paths_.clear();
+	path_ids_.clear();
+	tag_ids_.clear();
+
 	path_ = "";
-	db_ = nullptr;
 	created_ = false;
+	wal_ = false;
 }
 
-void Cache::err_exit(std::string msg, int rc) {
-	close();
-
-	//fmt::print("SQLITE ERROR: {}: {}\n", msg, sqlite3_errmsg(db_));
-	fmt::print("SQLITE ERROR({}): {}: {}\n", rc, msg, sqlite3_errstr(rc));
-	std::exit(1);
+void Cache::throw_error(std::string msg, int rc) {
+	throw CacheError(msg, rc);
 }
 
 bool Cache::create() {
@@ -84,10 +118,10 @@ bool Cache::create() {
 	while(psql < end) {
 		sqlite3_stmt* stmt = nullptr;
 
-		int rc = sqlite3_prepare_v2(db_, psql, psql_len, &stmt, &tail);
+		int rc = sqlite3_prepare_v2(writer_.db, psql, psql_len, &stmt, &tail);
 		if(rc != SQLITE_OK) {
 			created_ = false;
-			err_exit("create(prepare)", rc);
+			throw_error("create(prepare)", rc);
 			return false;
 		}
 
@@ -96,7 +130,7 @@ bool Cache::create() {
 		if(stmt) {
 			rc = sqlite3_step(stmt);
 			if(rc != SQLITE_DONE) {
-				err_exit("create(step)", rc);
+				throw_error("create(step)", rc);
 			}
 		}
 
@@ -107,241 +141,797 @@ bool Cache::create() {
 		psql = tail;
 	}
 
+	exec_or_throw(fmt::format("PRAGMA user_version = {}", SCHEMA_VERSION),
+		"create(user_version)");
+
 	created_ = true;
 	return true;
 }
 
+int Cache::schema_version() {
+	sqlite3_stmt* stmt = nullptr;
+	int rc = sqlite3_prepare_v2(writer_.db, "PRAGMA user_version", -1, &stmt, nullptr);
+	if(rc != SQLITE_OK) {
+		throw_error("schema_version(prepare)", rc);
+	}
+
+	int version = 0;
+	if(sqlite3_step(stmt) == SQLITE_ROW) {
+		version = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+
+	return version;
+}
+
+std::string Cache::current_journal_mode() {
+	sqlite3_stmt* stmt = nullptr;
+	int rc = sqlite3_prepare_v2(writer_.db, "PRAGMA journal_mode", -1, &stmt, nullptr);
+	if(rc != SQLITE_OK) {
+		throw_error("journal_mode(prepare)", rc);
+	}
+
+	std::string mode;
+	if(sqlite3_step(stmt) == SQLITE_ROW) {
+		auto text = sqlite3_column_text(stmt, 0);
+		mode = text ? (const char*)text : "";
+	}
+	sqlite3_finalize(stmt);
+
+	return mode;
+}
+
+void Cache::exec_or_throw(std::string const& sql, const char* errmsg) {
+	int rc = sqlite3_exec(writer_.db, sql.c_str(), nullptr, nullptr, nullptr);
+	if(rc != SQLITE_OK) {
+		throw_error(errmsg, rc);
+	}
+}
+
+namespace {
+	bool one_of(std::string const& value, std::vector<std::string> const& values) {
+		std::string v = value;
+		std::transform(v.begin(), v.end(), v.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return std::find(values.begin(), values.end(), v) != values.end();
+	}
+}
+
+bool Cache::journal_mode(std::string const& mode) {
+	if(!one_of(mode, {"delete", "truncate", "persist", "memory", "wal", "off"})) {
+		return false;
+	}
+	WriteLock lock(write_mutex_);
+	exec_or_throw("PRAGMA journal_mode = " + mode, "journal_mode");
+	wal_ = current_journal_mode() == "wal";
+	return true;
+}
+
+bool Cache::synchronous(std::string const& level) {
+	if(!one_of(level, {"off", "normal", "full", "extra", "0", "1", "2", "3"})) {
+		return false;
+	}
+	WriteLock lock(write_mutex_);
+	exec_or_throw("PRAGMA synchronous = " + level, "synchronous");
+	return true;
+}
+
+void Cache::begin(std::string const& name) {
+	// unlocked by matching commit() or rollback()
+	write_mutex_.lock();
+	try {
+		exec_or_throw("SAVEPOINT " + name, "begin");
+	} catch(...) {
+		write_mutex_.unlock();
+		throw;
+	}
+	savepoints_.push_back(name);
+	owner_ = std::this_thread::get_id();
+}
+
+void Cache::commit() {
+	WriteLock lock(write_mutex_);
+	if(savepoints_.empty()) {
+		return;
+	}
+	exec_or_throw("RELEASE " + savepoints_.back(), "commit");
+	savepoints_.pop_back();
+	if(savepoints_.empty()) {
+		pending_ = 0;
+		owner_ = std::thread::id();
+	}
+	write_mutex_.unlock();
+	batch();
+}
+
+void Cache::rollback() {
+	WriteLock lock(write_mutex_);
+	if(savepoints_.empty()) {
+		return;
+	}
+	auto const& name = savepoints_.back();
+	exec_or_throw("ROLLBACK TO " + name, "rollback");
+	exec_or_throw("RELEASE " + name, "rollback(release)");
+	savepoints_.pop_back();
+	if(savepoints_.empty()) {
+		pending_ = 0;
+		owner_ = std::thread::id();
+	}
+	write_mutex_.unlock();
+
+	// rows inserted since savepoint are gone
+	path_ids_.clear();
+	tag_ids_.clear();
+	load_ids();
+}
+
+void Cache::rollback_all() {
+	WriteLock lock(write_mutex_);
+	while(!savepoints_.empty()) {
+		rollback();
+	}
+}
+
+Cache::Conn* Cache::acquire(std::unique_lock<std::recursive_mutex>& lock) {
+	if(!wal_ || owner_ == std::this_thread::get_id()) {
+		lock = std::unique_lock<std::recursive_mutex>(write_mutex_);
+		return &writer_;
+	}
+
+	std::lock_guard<std::mutex> guard(readers_mutex_);
+	if(!free_readers_.empty()) {
+		auto conn = free_readers_.back();
+		free_readers_.pop_back();
+		return conn;
+	}
+
+	auto conn = std::make_unique<Conn>();
+	int rc = sqlite3_open_v2(path_.c_str(), &conn->db, SQLITE_OPEN_READONLY, nullptr);
+	if(rc != SQLITE_OK) {
+		close_conn(*conn);
+		throw_error("acquire(open)", rc);
+	}
+	sqlite3_extended_result_codes(conn->db, 1);
+	readers_.push_back(std::move(conn));
+	return readers_.back().get();
+}
+
+void Cache::release(Conn* conn) {
+	if(conn == &writer_) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(readers_mutex_);
+	free_readers_.push_back(conn);
+}
+
+// commit outermost transaction and start new one when enough writes
+// accumulated, only possible when there are no nested savepoints
+void Cache::batch() {
+	if(batch_size_ <= 0 || savepoints_.size() != 1 || pending_ < batch_size_) {
+		return;
+	}
+	auto const& name = savepoints_.front();
+	exec_or_throw("RELEASE " + name, "batch(release)");
+	exec_or_throw("SAVEPOINT " + name, "batch(savepoint)");
+	pending_ = 0;
+}
+
 
 template<size_t N>
 constexpr int length(char const (&)[N]) {
 	return static_cast<int>(N - 1);
 }
 
-void Cache::prepare_or_exit(const char *sql, int max_len,
-	sqlite3_stmt** stmt, const char** tail, const char* errmsg) {
-	int rc = sqlite3_prepare_v2(db_, sql, max_len, stmt, tail);
+// statements are kept prepared until close(), sql is used as key without
+// copying so it has to outlive Cache (all queries are static arrays)
+sqlite3_stmt* Cache::prepare_cached(Conn& conn, const char* sql, int len,
+	const char* errmsg) {
+	auto key = std::string_view(sql, static_cast<size_t>(len));
+
+	auto it = conn.stmts.find(key);
+	if(it != conn.stmts.end()) {
+		++stmt_hits_;
+		sqlite3_reset(it->second);
+		sqlite3_clear_bindings(it->second);
+		return it->second;
+	}
+
+	++stmt_misses_;
+	sqlite3_stmt* stmt = nullptr;
+	int rc = sqlite3_prepare_v3(conn.db, sql, len, SQLITE_PREPARE_PERSISTENT,
+		&stmt, nullptr);
 	if(rc != SQLITE_OK) {
-		err_exit(errmsg, rc);
+		throw_error(errmsg, rc);
+	}
+	conn.stmts.emplace(key, stmt);
+#ifdef CHECK_SQL
+	check_plan(conn.db, key, errmsg);
+#endif
+	return stmt;
+}
+
+#ifdef CHECK_SQL
+// every cached query must be served by indexes (scan of partial index reads
+// only rows it covers), queries where scan or sort cannot be avoided name
+// it with "-- scan <table or alias>: reason" or "-- sort: reason" comment
+void Cache::check_plan(sqlite3* db, std::string_view sql, const char* errmsg) {
+	std::unordered_set<std::string_view> scans;
+	for(auto pos = sql.find("-- scan "); pos != std::string_view::npos;
+		pos = sql.find("-- scan ", pos + 1)) {
+
+		auto name = sql.substr(pos + 8);
+		scans.insert(name.substr(0, name.find(':')));
+	}
+	bool sorts = sql.find("-- sort:") != std::string_view::npos;
+
+	auto query = [&](std::string const& q, auto&& cb) {
+		sqlite3_stmt* stmt = nullptr;
+		int rc = sqlite3_prepare_v2(db, q.c_str(), -1, &stmt, nullptr);
+		if(rc != SQLITE_OK) {
+			throw_error(errmsg, rc);
+		}
+		while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+			cb(Row(stmt));
+		}
+		sqlite3_finalize(stmt);
+		if(rc != SQLITE_DONE) {
+			throw_error(errmsg, rc);
+		}
+	};
+
+	std::unordered_set<std::string> partial;
+	query("SELECT name FROM sqlite_schema WHERE type = 'index' AND sql LIKE '% WHERE %'",
+		[&](Row const& row) {
+		partial.emplace(row[0]);
+	});
+
+	std::vector<std::string> bad;
+	query(fmt::format("EXPLAIN QUERY PLAN {}", sql), [&](Row const& row) {
+		// columns: id, parent, notused, detail
+		auto d = row[3];
+		bool bad_scan = false;
+		if(d.substr(0, 5) == "SCAN " && d != "SCAN CONSTANT ROW") {
+			auto name = d.substr(5, d.find(' ', 5) - 5);
+			std::string_view index;
+			if(auto pos = d.find(" INDEX "); pos != std::string_view::npos) {
+				index = d.substr(pos + 7);
+				index = index.substr(0, index.find(' '));
+			}
+			bad_scan = !scans.count(name) && !partial.count(std::string(index));
+		}
+		bool bad_sort = !sorts &&
+			d.find("USE TEMP B-TREE FOR") != std::string_view::npos;
+		if(bad_scan || bad_sort) {
+			bad.emplace_back(d);
+		}
+	});
+
+	if(!bad.empty()) {
+		fmt::print(stderr, "SQL PLAN: {}:{}\n", errmsg, sql);
+		for(auto const& d : bad) {
+			fmt::print(stderr, "  {}\n", d);
+		}
+		throw_error(errmsg, SQLITE_ERROR);
 	}
 }
+#endif
 
-void Cache::bind_or_exit(sqlite3_stmt* stmt, int idx,
+void Cache::bind_or_throw(sqlite3_stmt* stmt, int idx,
 	const char* value, int size, const char* errmsg) {
 	int rc = sqlite3_bind_text(stmt, idx, value, size, SQLITE_STATIC);
 	if(rc != SQLITE_OK) {
-		sqlite3_finalize(stmt);
-		err_exit(errmsg, rc);
+		sqlite3_reset(stmt);
+		throw_error(errmsg, rc);
 	}
 }
 
-void Cache::bind_or_exit(sqlite3_stmt* stmt, int idx,
+void Cache::bind_or_throw(sqlite3_stmt* stmt, int idx,
 	std::string const& value, const char* errmsg) {
 	int rc = sqlite3_bind_text(stmt, idx,
 		value.c_str(), static_cast<int>(value.size()), SQLITE_STATIC);
 	if(rc != SQLITE_OK) {
-		sqlite3_finalize(stmt);
-		err_exit(errmsg, rc);
+		sqlite3_reset(stmt);
+		throw_error(errmsg, rc);
 	}
 }
 
-void Cache::bind_or_exit(sqlite3_stmt* stmt, int idx,
+void Cache::bind_or_throw(sqlite3_stmt* stmt, int idx,
 	int value, const char* errmsg) {
 	int rc = sqlite3_bind_int(stmt, idx, value);
 	if(rc != SQLITE_OK) {
-		sqlite3_finalize(stmt);
-		err_exit(errmsg, rc);
+		sqlite3_reset(stmt);
+		throw_error(errmsg, rc);
 	}
 }
 
-void Cache::bind_or_exit(sqlite3_stmt* stmt, int idx,
+void Cache::bind_or_throw(sqlite3_stmt* stmt, int idx,
 	sqlite3_int64 value, const char* errmsg) {
 	int rc = sqlite3_bind_int64(stmt, idx, value);
 	if(rc != SQLITE_OK) {
-		sqlite3_finalize(stmt);
-		err_exit(errmsg, rc);
+		sqlite3_reset(stmt);
+		throw_error(errmsg, rc);
 	}
 }
 
 
+void Cache::load_ids() {
+	auto load = [this](const char* sql, Ids& ids) {
+		sqlite3_stmt* stmt = nullptr;
+		int rc = sqlite3_prepare_v2(writer_.db, sql, -1, &stmt, nullptr);
+		if(rc != SQLITE_OK) {
+			throw_error("load_ids(prepare)", rc);
+		}
+		while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+			auto name = sqlite3_column_text(stmt, 1);
+			ids.emplace(name ? (const char*)name : "", sqlite3_column_int64(stmt, 0));
+		}
+		sqlite3_finalize(stmt);
+		if(rc != SQLITE_DONE) {
+			throw_error("load_ids(step)", rc);
+		}
+	};
+
+	load("SELECT id, name FROM paths", path_ids_);
+	load("SELECT id, name FROM tags", tag_ids_);
+}
+
 sqlite3_int64 Cache::get_id(
-	std::string const& name,
+	std::string const& name, Ids& ids,
 	const char* sql_insert, int sql_insert_len,
-	const char* sql_select, int sql_select_len
+	const char* sql_select, int sql_select_len,
+	bool* inserted
 ) {
+	auto it = ids.find(name);
+	if(it != ids.end()) {
+		if(inserted) {
+			*inserted = false;
+		}
+		return it->second;
+	}
+
 	// try to insert
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_insert, sql_insert_len, &stmt, nullptr,
+	sqlite3_stmt* stmt = prepare_cached(sql_insert, sql_insert_len,
 		"get_id(prepare insert)");
 
-	bind_or_exit(stmt, 1, name, "get_id(bind insert)");
+	bind_or_throw(stmt, 1, name, "get_id(bind insert)");
 
 	int rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
+	if(rc != SQLITE_DONE) {
+		throw_error("get_id(step insert)", rc);
+	}
+	if(inserted) {
+		*inserted = sqlite3_changes(writer_.db) > 0;
+	}
+	if(sqlite3_changes(writer_.db) > 0) {
+		return ids.emplace(name, sqlite3_last_insert_rowid(writer_.db)).first->second;
+	}
 
 
-	// select id
+	// already there (added by someone else), select id
 
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
+	stmt = prepare_cached(sql_select, sql_select_len,
 		"get_id(prepare select)");
 
-	bind_or_exit(stmt, 1, name, "get_id(bind select)");
+	bind_or_throw(stmt, 1, name, "get_id(bind select)");
 
 	rc = sqlite3_step(stmt);
 	if(rc == SQLITE_ROW) {
 		auto ret = sqlite3_column_int64(stmt, 0);
-		sqlite3_finalize(stmt);
-		return ret;
+		sqlite3_reset(stmt);
+		return ids.emplace(name, ret).first->second;
 	}
 
-	sqlite3_finalize(stmt);
-	err_exit("get_id(step)", rc);
+	sqlite3_reset(stmt);
+	throw_error("get_id(step)", rc);
 
 	return 0;
 }
 
 sqlite3_int64 Cache::path_id(std::string const& path) {
-	const char sql_insert[] = "INSERT OR IGNORE INTO paths(name) VALUES(?)";
+	WriteLock lock(write_mutex_);
+
+	static const char sql_insert[] = "INSERT OR IGNORE INTO paths(name) VALUES(?)";
 	constexpr const int sql_insert_len = length(sql_insert);
-	const char sql_select[] = "SELECT id FROM paths WHERE name = ?";
+	static const char sql_select[] = "SELECT id FROM paths WHERE name = ?";
 	constexpr const int sql_select_len = length(sql_select);
 
-	return get_id(path, sql_insert, sql_insert_len, sql_select, sql_select_len);
+	bool inserted = false;
+	auto id = get_id(path, path_ids_, sql_insert, sql_insert_len,
+		sql_select, sql_select_len, &inserted);
+	if(inserted) {
+		new_paths_.emplace(id, path);
+
+		// link to parent (created when missing) so subpaths are found by index
+		if(!path.empty()) {
+			auto pos = path.rfind('/');
+			auto parent = path_id(pos == std::string::npos ? "" : path.substr(0, pos));
+
+			static const char sql_parent[] = "UPDATE paths SET parent = ?1 WHERE id = ?2";
+			constexpr const int sql_parent_len = length(sql_parent);
+
+			sqlite3_stmt* stmt = prepare_cached(sql_parent, sql_parent_len,
+				"path_id(prepare parent)");
+			bind_or_throw(stmt, 1, parent, "path_id(bind parent)");
+			bind_or_throw(stmt, 2, id, "path_id(bind id)");
+
+			int rc = sqlite3_step(stmt);
+			sqlite3_reset(stmt);
+			if(rc != SQLITE_DONE) {
+				throw_error("path_id(step parent)", rc);
+			}
+		}
+	}
+	return id;
 }
 
-sqlite3_int64 Cache::tag_id(std::string const& tag) {
-	const char sql_insert[] = "INSERT OR IGNORE INTO tags(name) VALUES(?)";
+sqlite3_int64 Cache::tag_id(std::string const& tag, bool* inserted) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_insert[] = "INSERT OR IGNORE INTO tags(name) VALUES(?)";
 	constexpr const int sql_insert_len = length(sql_insert);
-	const char sql_select[] = "SELECT id FROM tags WHERE name = ?";
+	static const char sql_select[] = "SELECT id FROM tags WHERE name = ?";
 	constexpr const int sql_select_len = length(sql_select);
 
-	return get_id(tag, sql_insert, sql_insert_len, sql_select, sql_select_len);
+	return get_id(tag, tag_ids_, sql_insert, sql_insert_len,
+		sql_select, sql_select_len, inserted);
 }
 
 
-sqlite3_int64 Cache::add_entry(Entry const& entry) {
-	const char sql_upsert[] = R"~(
+std::optional<OutputState> Cache::entry_output(Entry const& entry) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_select[] = R"~(
+		SELECT hash, mtime, excerpt, read_more, meta FROM entries
+			WHERE path = ?1 AND slug = ?2 AND file = ?3
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_select, sql_select_len,
+		"entry_output(prepare select)");
+
+	bind_or_throw(stmt, 1, entry.path, "entry_output(bind path)");
+	if(entry.slug) {
+		bind_or_throw(stmt, 2, *entry.slug, "entry_output(bind slug)");
+	} else {
+		bind_or_throw(stmt, 2, "", "entry_output(bind slug='')");
+	}
+	bind_or_throw(stmt, 3, entry.file, "entry_output(bind file)");
+
+	std::optional<OutputState> ret;
+	int rc = sqlite3_step(stmt);
+	if(rc == SQLITE_ROW) {
+		auto text = [stmt](int col) {
+			auto value = sqlite3_column_text(stmt, col);
+			return std::string(value ? (char*)value : "");
+		};
+		ret = OutputState{text(0), sqlite3_column_int64(stmt, 1),
+			text(2), sqlite3_column_int(stmt, 3) != 0, text(4)};
+	} else if(rc != SQLITE_DONE) {
+		sqlite3_reset(stmt);
+		throw_error("entry_output(step)", rc);
+	}
+	sqlite3_reset(stmt);
+
+	return ret;
+}
+
+sqlite3_int64 Cache::upsert_entry(Entry const& entry, int* changed) {
+	static const char sql_upsert[] = R"~(
 		INSERT
-			--           1     2       3     4     5     6      7        8
-			INTO entries(type, source, path, slug, file, title, created, updated)
-			VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)
+			--           1     2       3     4     5     6      7        8        9
+			INTO entries(type, source, path, slug, file, title, created, updated, hash,
+			--  10       11         12    13
+				excerpt, read_more, meta, mtime)
+			VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13)
 		ON CONFLICT(path, slug, file) DO UPDATE
-			SET type = ?1, source = ?2, title = ?6, updated = ?8
+			SET type = ?1, source = ?2, title = ?6, created = ?7, updated = ?8,
+				hash = ?9, excerpt = ?10, read_more = ?11, meta = ?12,
+				mtime = ?13, changed = (CASE WHEN type IS NOT ?1 THEN 2
+					WHEN title IS NOT ?6 OR created IS NOT ?7 OR
+						updated IS NOT ?8 THEN 1
+					ELSE 0 END)
 			WHERE path = ?3 AND slug = ?4 AND file = ?5
+		RETURNING id, changed
 	)~";
 	constexpr const int sql_upsert_len = length(sql_upsert);
+	// older sqlite (< 3.35) gets same statement without RETURNING
+	constexpr const int sql_upsert_plain_len = static_cast<int>(
+		std::string_view(sql_upsert).find("RETURNING"));
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_upsert, sql_upsert_len, &stmt, nullptr,
-		"add_entry(prepare)");
+	sqlite3_stmt* stmt = prepare_cached(sql_upsert,
+		returning_ ? sql_upsert_len : sql_upsert_plain_len, "add_entry(prepare)");
 
-	bind_or_exit(stmt, 1, static_cast<int>(entry.type), "add_entry(bind type)");
-	bind_or_exit(stmt, 2, entry.source, "add_entry(bind source)");
+	bind_or_throw(stmt, 1, static_cast<int>(entry.type), "add_entry(bind type)");
+	bind_or_throw(stmt, 2, entry.source, "add_entry(bind source)");
 
-	bind_or_exit(stmt, 3, entry.path, "add_entry(bind path)");
+	bind_or_throw(stmt, 3, entry.path, "add_entry(bind path)");
 	if(entry.slug) {
-		bind_or_exit(stmt, 4, *entry.slug, "add_entry(bind slug)");
+		bind_or_throw(stmt, 4, *entry.slug, "add_entry(bind slug)");
 	} else {
-		bind_or_exit(stmt, 4, "", "add_entry(bind slug='')");
+		bind_or_throw(stmt, 4, "", "add_entry(bind slug='')");
 	}
-	bind_or_exit(stmt, 5, entry.file, "add_entry(bind file)");
+	bind_or_throw(stmt, 5, entry.file, "add_entry(bind file)");
 	if(entry.title) {
-		bind_or_exit(stmt, 6, *entry.title, "add_entry(bind title)");
+		bind_or_throw(stmt, 6, *entry.title, "add_entry(bind title)");
 	} else {
-		bind_or_exit(stmt, 6, nullptr, 0, "add_entry(bind title=NULL)");
+		bind_or_throw(stmt, 6, nullptr, 0, "add_entry(bind title=NULL)");
 	}
-	bind_or_exit(stmt, 7, entry.created, "add_entry(bind created)");
+	bind_or_throw(stmt, 7, entry.created, "add_entry(bind created)");
 	if(entry.update) {
-		bind_or_exit(stmt, 8, entry.updated, "add_entry(bind updated)");
+		bind_or_throw(stmt, 8, entry.updated, "add_entry(bind updated)");
 	} else {
-		bind_or_exit(stmt, 8, nullptr, 0, "add_entry(bind updated=NULL)");
+		bind_or_throw(stmt, 8, nullptr, 0, "add_entry(bind updated=NULL)");
+	}
+	if(!entry.hash.empty()) {
+		bind_or_throw(stmt, 9, entry.hash, "add_entry(bind hash)");
+	} else {
+		bind_or_throw(stmt, 9, nullptr, 0, "add_entry(bind hash=NULL)");
+	}
+	if(entry.type == Type::Entry) {
+		bind_or_throw(stmt, 10, entry.excerpt, "add_entry(bind excerpt)");
+		bind_or_throw(stmt, 12, entry.meta, "add_entry(bind meta)");
+	} else {
+		bind_or_throw(stmt, 10, nullptr, 0, "add_entry(bind excerpt=NULL)");
+		bind_or_throw(stmt, 12, nullptr, 0, "add_entry(bind meta=NULL)");
+	}
+	bind_or_throw(stmt, 11, entry.read_more ? 1 : 0, "add_entry(bind read_more)");
+	if(entry.mtime) {
+		bind_or_throw(stmt, 13, entry.mtime, "add_entry(bind mtime)");
+	} else {
+		bind_or_throw(stmt, 13, nullptr, 0, "add_entry(bind mtime=NULL)");
 	}
 
 	int rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	if(returning_) {
+		if(rc == SQLITE_ROW) {
+			auto ret = sqlite3_column_int64(stmt, 0);
+			*changed = sqlite3_column_int(stmt, 1);
+			sqlite3_reset(stmt);
+			++pending_;
+			return ret;
+		}
+		sqlite3_reset(stmt);
+		throw_error("add_entry(step)", rc);
+	}
+	sqlite3_reset(stmt);
 	if(rc != SQLITE_DONE) {
-		err_exit("add_entry(step)", rc);
+		throw_error("add_entry(step)", rc);
 	}
+	++pending_;
 
 
 	// select id
-	const char sql_select[] = R"~(
-		SELECT id FROM entries
+	static const char sql_select[] = R"~(
+		SELECT id, changed FROM entries
 			WHERE path = ?1 AND slug = ?2 AND file = ?3
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
+	stmt = prepare_cached(sql_select, sql_select_len,
 		"add_entry(prepare select)");
 
-	bind_or_exit(stmt, 1, entry.path, "add_entry(bind path)");
+	bind_or_throw(stmt, 1, entry.path, "add_entry(bind path)");
 	if(entry.slug) {
-		bind_or_exit(stmt, 2, *entry.slug, "add_entry(bind slug)");
+		bind_or_throw(stmt, 2, *entry.slug, "add_entry(bind slug)");
 	} else {
-		bind_or_exit(stmt, 2, "", "add_entry(bind slug='')");
+		bind_or_throw(stmt, 2, "", "add_entry(bind slug='')");
 	}
-	bind_or_exit(stmt, 3, entry.file, "add_entry(bind file)");
+	bind_or_throw(stmt, 3, entry.file, "add_entry(bind file)");
 
 	rc = sqlite3_step(stmt);
 	if(rc == SQLITE_ROW) {
 		auto ret = sqlite3_column_int64(stmt, 0);
-		sqlite3_finalize(stmt);
+		*changed = sqlite3_column_int(stmt, 1);
+		sqlite3_reset(stmt);
 		return ret;
 	}
 
-	sqlite3_finalize(stmt);
-	err_exit("add_entry(step select)", rc);
+	sqlite3_reset(stmt);
+	throw_error("add_entry(step select)", rc);
 
 	return 0;
 }
 
-void Cache::add_tag(sqlite3_int64 entry, std::string const& tag) {
-	const char sql_upsert[] = R"~(
+sqlite3_int64 Cache::add_entry(Entry const& entry) {
+	WriteLock lock(write_mutex_);
+
+	int changed = CHANGE_NONE;
+	auto id = upsert_entry(entry, &changed);
+	mark_entry(entry, id, changed);
+	batch();
+	return id;
+}
+
+std::vector<sqlite3_int64> Cache::add_entries(std::vector<Entry> entries) {
+	WriteLock lock(write_mutex_);
+
+	std::vector<sqlite3_int64> ids;
+	ids.reserve(entries.size());
+	for(auto const& entry : entries) {
+		int changed = CHANGE_NONE;
+		auto id = upsert_entry(entry, &changed);
+		mark_entry(entry, id, changed);
+		ids.push_back(id);
+	}
+	batch();
+	return ids;
+}
+
+void Cache::add_tag(sqlite3_int64 entry, std::string const& tag_name) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_upsert[] = R"~(
 		INSERT OR IGNORE INTO tagged_entries(tag, entry) VALUES(?, ?)
 	)~";
 	constexpr const int sql_upsert_len = length(sql_upsert);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_upsert, sql_upsert_len, &stmt, nullptr,
+	sqlite3_stmt* stmt = prepare_cached(sql_upsert, sql_upsert_len,
 		"add_tag(prepare)");
 
-	bind_or_exit(stmt, 1, tag_id(tag), "add_tag(bind tag)");
-	bind_or_exit(stmt, 2, entry, "add_tag(bind entry)");
+	bool new_tag = false;
+	auto tag = tag_id(tag_name, &new_tag);
+
+	bind_or_throw(stmt, 1, tag, "add_tag(bind tag)");
+	bind_or_throw(stmt, 2, entry, "add_tag(bind entry)");
 
 	int rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_reset(stmt);
 	if(rc != SQLITE_DONE) {
-		err_exit("add_tag(step)", rc);
+		throw_error("add_tag(step)", rc);
+	}
+
+	if(sqlite3_changes(writer_.db) > 0) {
+		static const char sql_mark[] = "UPDATE tags SET dirty = 1 WHERE id = ?";
+		constexpr const int sql_mark_len = length(sql_mark);
+		exec_id(sql_mark, sql_mark_len, tag, "add_tag(mark)");
+	}
+	if(new_tag) {
+		mark_path(path_id("tags"));
 	}
+
+	++pending_;
+	batch();
 }
 
-void Cache::list_things(sqlite3_stmt* stmt, int count, QueryCallback cb) {
+void Cache::set_tags(sqlite3_int64 entry, std::vector<std::string> const& tags) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_select[] = R"~(
+		SELECT tags.id, tags.name FROM tags, tagged_entries
+			WHERE tagged_entries.entry = ? AND tags.id = tagged_entries.tag
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_select, sql_select_len,
+		"set_tags(prepare select)");
+
+	bind_or_throw(stmt, 1, entry, "set_tags(bind entry)");
+
+	std::unordered_set<std::string> current;
+	std::vector<sqlite3_int64> removed;
 	while(1) {
 		int rc = sqlite3_step(stmt);
 		if(rc == SQLITE_ROW) {
-			std::vector<std::string> result;
-			for(int i=0; i<count; ++i) {
-				auto value = sqlite3_column_text(stmt, i);
-				if(value) {
-					result.emplace_back((char*)value);
-				} else {
-					result.emplace_back("");
-				}
+			auto name = std::string((char*)sqlite3_column_text(stmt, 1));
+			if(std::find(tags.begin(), tags.end(), name) == tags.end()) {
+				removed.push_back(sqlite3_column_int64(stmt, 0));
 			}
-			cb(result);
+			current.insert(name);
 		} else if(rc == SQLITE_DONE) {
 			break;
 		} else {
-			sqlite3_finalize(stmt);
-			err_exit("list_tags(step)", rc);
+			sqlite3_reset(stmt);
+			throw_error("set_tags(step)", rc);
+		}
+	}
+	sqlite3_reset(stmt);
+
+	static const char sql_delete[] = R"~(
+		DELETE FROM tagged_entries WHERE tag = ?1 AND entry = ?2
+	)~";
+	constexpr const int sql_delete_len = length(sql_delete);
+	static const char sql_mark[] = "UPDATE tags SET dirty = 1 WHERE id = ?";
+	constexpr const int sql_mark_len = length(sql_mark);
+
+	for(auto tag : removed) {
+		stmt = prepare_cached(sql_delete, sql_delete_len,
+			"set_tags(prepare delete)");
+		bind_or_throw(stmt, 1, tag, "set_tags(bind tag)");
+		bind_or_throw(stmt, 2, entry, "set_tags(bind entry)");
+		int rc = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+		if(rc != SQLITE_DONE) {
+			throw_error("set_tags(step delete)", rc);
+		}
+
+		exec_id(sql_mark, sql_mark_len, tag, "set_tags(mark)");
+	}
+
+	for(auto const& tag : tags) {
+		if(!current.count(tag)) {
+			add_tag(entry, tag);
+		}
+	}
+}
+
+void Cache::exec_id(const char* sql, int sql_len, sqlite3_int64 id,
+	const char* errmsg) {
+	sqlite3_stmt* stmt = prepare_cached(sql, sql_len, errmsg);
+
+	bind_or_throw(stmt, 1, id, errmsg);
+
+	int rc = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	if(rc != SQLITE_DONE) {
+		throw_error(errmsg, rc);
+	}
+}
+
+void Cache::mark_path(sqlite3_int64 path) {
+	static const char sql_mark[] = "UPDATE paths SET dirty = 1 WHERE id = ?";
+	constexpr const int sql_mark_len = length(sql_mark);
+
+	exec_id(sql_mark, sql_mark_len, path, "mark_path");
+}
+
+// entry written to output changes index, change of title or dates also
+// changes list page of its path and pages of its tags
+void Cache::mark_entry(Entry const& entry, sqlite3_int64 id, int changed) {
+	static const char sql_mark_tags[] = R"~(
+		UPDATE tags SET dirty = 1
+			WHERE id IN (SELECT tag FROM tagged_entries WHERE entry = ?)
+	)~";
+	constexpr const int sql_mark_tags_len = length(sql_mark_tags);
+
+	if(entry.type != Type::Entry) {
+		// entry turned into page disappears from index, its list and its
+		// tags (only entries have tags, for other types nothing is marked)
+		if(changed == CHANGE_TYPE) {
+			static const char sql_delete_tags[] = R"~(
+				DELETE FROM tagged_entries WHERE entry = ?
+			)~";
+			constexpr const int sql_delete_tags_len = length(sql_delete_tags);
+
+			mark_path(path_id(""));
+			mark_path(entry.path);
+			exec_id(sql_mark_tags, sql_mark_tags_len, id, "mark_entry(old tags)");
+			exec_id(sql_delete_tags, sql_delete_tags_len, id,
+				"mark_entry(delete tags)");
+		}
+		return;
+	}
+
+	mark_path(path_id(""));
+
+	if(changed == CHANGE_NONE) {
+		return;
+	}
+
+	mark_path(entry.path);
+
+	exec_id(sql_mark_tags, sql_mark_tags_len, id, "mark_entry(tags)");
+
+	// new path shows up in lists of all its parents
+	auto it = new_paths_.find(entry.path);
+	if(it != new_paths_.end()) {
+		auto name = it->second;
+		new_paths_.erase(it);
+
+		auto pos = name.rfind('/');
+		while(pos != std::string::npos) {
+			name.resize(pos);
+			mark_path(path_id(name));
+			pos = name.rfind('/');
 		}
 	}
-	sqlite3_finalize(stmt);
 }
 
-void Cache::last_entries(int count, QueryCallback cb) {
-	const char sql_select[] = R"~(
-		SELECT name as path, slug, file, title, created, updated, source
+sqlite3_stmt* Cache::last_entries_stmt(Conn& conn, int count) {
+	static const char sql_select[] = R"~(
+		SELECT name as path, slug, file, title, created, updated,
+			excerpt, read_more, meta
 		FROM entries, paths
 		WHERE type = ? AND paths.id = entries.path
 		ORDER BY IFNULL(updated, created) DESC
@@ -349,41 +939,43 @@ void Cache::last_entries(int count, QueryCallback cb) {
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
 		"last_entries(prepare select)");
 
-	bind_or_exit(stmt, 1, static_cast<int>(Type::Entry), "last_entries(bind type)");
-	bind_or_exit(stmt, 2, count, "last_entries(bind limit)");
+	bind_or_throw(stmt, 1, static_cast<int>(Type::Entry), "last_entries(bind type)");
+	bind_or_throw(stmt, 2, count, "last_entries(bind limit)");
 
-	list_things(stmt, 7, cb);
+	return stmt;
 }
 
-void Cache::list_subpaths(sqlite3_int64 path, QueryCallback cb) {
-	const char sql_select[] = R"~(
+sqlite3_stmt* Cache::list_subpaths_stmt(Conn& conn, sqlite3_int64 path) {
+	// all descendants, walked through parent index
+	static const char sql_select[] = R"~(
+		-- scan sub: rows found by the walk itself
+		-- sort: only subpaths of one path are sorted
+		WITH RECURSIVE sub(id, name) AS (
+			SELECT id, name FROM paths WHERE parent = ?1
+			UNION ALL
+			SELECT paths.id, paths.name FROM paths, sub WHERE paths.parent = sub.id
+		)
 		SELECT
 			name,
-			substr(name, length(namestart)+1) AS subname
-		FROM
-			paths,
-			(SELECT name || '/' AS namestart FROM paths WHERE id = ?)
-		WHERE
-			substr(name, 0, length(namestart)+1) == namestart
+			substr(name, length((SELECT name FROM paths WHERE id = ?1)) + 2) AS subname
+		FROM sub
 		ORDER BY name DESC
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
-		"list_things(prepare select)");
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_subpaths(prepare select)");
 
-	bind_or_exit(stmt, 1, path, "list_subpaths(bind path)");
+	bind_or_throw(stmt, 1, path, "list_subpaths(bind path)");
 
-	list_things(stmt, 2, cb);
+	return stmt;
 }
 
-void Cache::list_entries_path(sqlite3_int64 path, QueryCallback cb) {
-	const char sql_select[] = R"~(
+sqlite3_stmt* Cache::list_entries_path_stmt(Conn& conn, sqlite3_int64 path) {
+	static const char sql_select[] = R"~(
 		SELECT
 			name as path, slug, file, title, created
 		FROM
@@ -395,49 +987,305 @@ void Cache::list_entries_path(sqlite3_int64 path, QueryCallback cb) {
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
 		"list_entries_path(prepare select)");
 
-	bind_or_exit(stmt, 1, static_cast<int>(Type::Entry), "list_entries_path(bind type)");
-	bind_or_exit(stmt, 2, path, "list_entries_path(bind path)");
+	bind_or_throw(stmt, 1, static_cast<int>(Type::Entry), "list_entries_path(bind type)");
+	bind_or_throw(stmt, 2, path, "list_entries_path(bind path)");
 
-	list_things(stmt, 5, cb);
+	return stmt;
 }
 
-void Cache::list_entries_tag(sqlite3_int64 tag, QueryCallback cb) {
-	const char sql_select[] = R"~(
+// entries of all dirty tags in one pass, rows of each tag come together
+// (CROSS JOIN keeps dirty tags as outer loop, otherwise planner may walk
+// all entries)
+sqlite3_stmt* Cache::list_dirty_tag_entries_stmt(Conn& conn) {
+	static const char sql_select[] = R"~(
+		-- sort: only entries of each dirty tag are sorted by date
 		SELECT
-			name as path, slug, file, title, created
+			tags.name AS tag, paths.name AS path, slug, file, title, created
 		FROM
-			entries, paths, tagged_entries
+			tags CROSS JOIN tagged_entries CROSS JOIN entries CROSS JOIN paths
 		WHERE
-			type = ? AND paths.id = entries.path AND
-			tag = ? AND entry = entries.id
-		ORDER BY created DESC
+			tags.dirty AND tagged_entries.tag = tags.id AND
+			entries.id = tagged_entries.entry AND type = ? AND
+			paths.id = entries.path
+		ORDER BY tags.name ASC, created DESC
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
-		"list_entries_tag(prepare select)");
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_dirty_tag_entries(prepare select)");
 
-	bind_or_exit(stmt, 1, static_cast<int>(Type::Entry), "list_entries_tag(bind type)");
-	bind_or_exit(stmt, 2, tag, "list_entries_tag(bind tag)");
+	bind_or_throw(stmt, 1, static_cast<int>(Type::Entry),
+		"list_dirty_tag_entries(bind type)");
 
-	list_things(stmt, 5, cb);
+	return stmt;
 }
 
-void Cache::list_tags(QueryCallback cb) {
-	const char sql_select[] = R"~(
+sqlite3_stmt* Cache::list_tags_stmt(Conn& conn) {
+	static const char sql_select[] = R"~(
+		-- scan tags: page listing all tags
 		SELECT name FROM tags ORDER BY name ASC
 	)~";
 	constexpr const int sql_select_len = length(sql_select);
 
-	sqlite3_stmt* stmt = nullptr;
-	prepare_or_exit(sql_select, sql_select_len, &stmt, nullptr,
-		"list_things(prepare select)");
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_tags(prepare select)");
+
+	return stmt;
+}
+
+
+sqlite3_stmt* Cache::list_dirty_paths_stmt(Conn& conn) {
+	static const char sql_select[] = R"~(
+		SELECT name FROM paths WHERE dirty ORDER BY name ASC
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_dirty_paths(prepare select)");
 
-	list_things(stmt, 1, cb);
+	return stmt;
 }
 
+sqlite3_stmt* Cache::list_dirty_tags_stmt(Conn& conn) {
+	static const char sql_select[] = R"~(
+		SELECT name FROM tags WHERE dirty ORDER BY name ASC
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_dirty_tags(prepare select)");
+
+	return stmt;
+}
+
+// everything generated before is outdated (e.g. templates changed)
+void Cache::mark_all() {
+	WriteLock lock(write_mutex_);
+
+	exec_or_throw(fmt::format(R"~(
+		UPDATE paths SET dirty = 1
+			WHERE id IN (SELECT path FROM entries WHERE type IN ({}, {}))
+	)~", static_cast<int>(Type::List), static_cast<int>(Type::Index)),
+		"mark_all(paths)");
+	exec_or_throw("UPDATE tags SET dirty = 1", "mark_all(tags)");
+}
+
+std::optional<std::string> Cache::state(std::string const& name) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_select[] = "SELECT value FROM state WHERE name = ?";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_select, sql_select_len,
+		"state(prepare select)");
+	bind_or_throw(stmt, 1, name, "state(bind name)");
+
+	std::optional<std::string> ret;
+	int rc = sqlite3_step(stmt);
+	if(rc == SQLITE_ROW) {
+		ret = (char*)sqlite3_column_text(stmt, 0);
+	} else if(rc != SQLITE_DONE) {
+		sqlite3_reset(stmt);
+		throw_error("state(step)", rc);
+	}
+	sqlite3_reset(stmt);
+
+	return ret;
+}
+
+void Cache::set_state(std::string const& name, std::string const& value) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_upsert[] = R"~(
+		INSERT INTO state(name, value) VALUES(?1, ?2)
+			ON CONFLICT(name) DO UPDATE SET value = ?2
+	)~";
+	constexpr const int sql_upsert_len = length(sql_upsert);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_upsert, sql_upsert_len,
+		"set_state(prepare)");
+	bind_or_throw(stmt, 1, name, "set_state(bind name)");
+	bind_or_throw(stmt, 2, value, "set_state(bind value)");
+
+	int rc = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	if(rc != SQLITE_DONE) {
+		throw_error("set_state(step)", rc);
+	}
+}
+
+sqlite3_stmt* Cache::list_sources_stmt(Conn& conn) {
+	// lists, index and feed have no source, attached files are owned by
+	// page or entry with same path and slug
+	static const char sql_select[] = R"~(
+		-- scan f: reconcile checks source of every output
+		SELECT f.id, f.type, f.source, name, f.slug, f.file, e.source
+		FROM entries AS f
+		JOIN paths ON paths.id = f.path
+		LEFT JOIN entries AS e ON f.type = ?1 AND
+			e.path = f.path AND e.slug = f.slug AND e.type IN (?2, ?3)
+		WHERE f.source != ''
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_sources(prepare select)");
+
+	bind_or_throw(stmt, 1, static_cast<int>(Type::File), "list_sources(bind file)");
+	bind_or_throw(stmt, 2, static_cast<int>(Type::Page), "list_sources(bind page)");
+	bind_or_throw(stmt, 3, static_cast<int>(Type::Entry), "list_sources(bind entry)");
+
+	return stmt;
+}
+
+sqlite3_stmt* Cache::list_source_outputs_stmt(Conn& conn,
+	std::string const& source) {
+
+	// attached files have own source, they share path and slug
+	static const char sql_select[] = R"~(
+		SELECT entries.id, path, name, slug, file
+		FROM entries, paths
+		WHERE source = ?1 AND type IN (?2, ?3, ?4) AND paths.id = entries.path
+		UNION
+		SELECT f.id, f.path, name, f.slug, f.file
+		FROM entries AS f, entries AS e, paths
+		WHERE e.source = ?1 AND e.type IN (?2, ?3) AND f.type = ?5 AND
+			f.path = e.path AND f.slug = e.slug AND paths.id = f.path
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_source_outputs(prepare select)");
+
+	bind_or_throw(stmt, 1, source, "list_source_outputs(bind source)");
+	bind_or_throw(stmt, 2, static_cast<int>(Type::Page), "list_source_outputs(bind page)");
+	bind_or_throw(stmt, 3, static_cast<int>(Type::Entry), "list_source_outputs(bind entry)");
+	bind_or_throw(stmt, 4, static_cast<int>(Type::Source), "list_source_outputs(bind source)");
+	bind_or_throw(stmt, 5, static_cast<int>(Type::File), "list_source_outputs(bind file)");
+
+	return stmt;
+}
+
+sqlite3_stmt* Cache::list_source_files_stmt(Conn& conn, Type type,
+	std::string const& source) {
+
+	static const char sql_select[] = R"~(
+		SELECT f.id, f.path, name, f.slug, f.file, e.source
+		FROM entries AS f
+		JOIN paths ON paths.id = f.path
+		LEFT JOIN entries AS e ON f.type = ?3 AND
+			e.path = f.path AND e.slug = f.slug AND e.type IN (?4, ?5)
+		WHERE f.source = ?1 AND f.type = ?2
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(conn, sql_select, sql_select_len,
+		"list_source_files(prepare select)");
+
+	bind_or_throw(stmt, 1, source, "list_source_files(bind source)");
+	bind_or_throw(stmt, 2, static_cast<int>(type), "list_source_files(bind type)");
+	bind_or_throw(stmt, 3, static_cast<int>(Type::File), "list_source_files(bind file)");
+	bind_or_throw(stmt, 4, static_cast<int>(Type::Page), "list_source_files(bind page)");
+	bind_or_throw(stmt, 5, static_cast<int>(Type::Entry), "list_source_files(bind entry)");
+
+	return stmt;
+}
+
+void Cache::remove_entry(sqlite3_int64 id) {
+	WriteLock lock(write_mutex_);
+
+	static const char sql_select[] = R"~(
+		SELECT type, path FROM entries WHERE id = ?
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_select, sql_select_len,
+		"remove_entry(prepare select)");
+	bind_or_throw(stmt, 1, id, "remove_entry(bind id)");
+
+	int rc = sqlite3_step(stmt);
+	if(rc != SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		if(rc != SQLITE_DONE) {
+			throw_error("remove_entry(step select)", rc);
+		}
+		return;
+	}
+	auto type = static_cast<Type>(sqlite3_column_int(stmt, 0));
+	auto path = sqlite3_column_int64(stmt, 1);
+	sqlite3_reset(stmt);
+
+	// entry disappears from index, its list and its tags
+	if(type == Type::Entry) {
+		mark_path(path_id(""));
+		mark_path(path);
+
+		static const char sql_mark_tags[] = R"~(
+			UPDATE tags SET dirty = 1
+				WHERE id IN (SELECT tag FROM tagged_entries WHERE entry = ?)
+		)~";
+		constexpr const int sql_mark_tags_len = length(sql_mark_tags);
+
+		exec_id(sql_mark_tags, sql_mark_tags_len, id, "remove_entry(mark tags)");
+	}
+
+	static const char sql_delete_tags[] = R"~(
+		DELETE FROM tagged_entries WHERE entry = ?
+	)~";
+	constexpr const int sql_delete_tags_len = length(sql_delete_tags);
+	static const char sql_delete[] = "DELETE FROM entries WHERE id = ?";
+	constexpr const int sql_delete_len = length(sql_delete);
+
+	exec_id(sql_delete_tags, sql_delete_tags_len, id, "remove_entry(delete tags)");
+	exec_id(sql_delete, sql_delete_len, id, "remove_entry(delete)");
+	batch();
+}
+
+void Cache::remove_unused_tags(std::function<void(std::string const&)> cb) {
+	WriteLock lock(write_mutex_);
+
+	// tag loses entries only together with being marked dirty
+	static const char sql_select[] = R"~(
+		SELECT id, name FROM tags
+			WHERE dirty AND id NOT IN (SELECT tag FROM tagged_entries)
+	)~";
+	constexpr const int sql_select_len = length(sql_select);
+
+	sqlite3_stmt* stmt = prepare_cached(sql_select, sql_select_len,
+		"remove_unused_tags(prepare select)");
+
+	std::vector<std::pair<sqlite3_int64, std::string>> unused;
+	auto add = [&](QueryResult tag) {
+		unused.emplace_back(tag.int64(0), tag[1]);
+	};
+	list_things(stmt, add);
+	if(unused.empty()) {
+		return;
+	}
+
+	// tag page goes away together with tag
+	static const char sql_delete_list[] = "DELETE FROM entries WHERE path = ?";
+	constexpr const int sql_delete_list_len = length(sql_delete_list);
+	static const char sql_delete[] = "DELETE FROM tags WHERE id = ?";
+	constexpr const int sql_delete_len = length(sql_delete);
+
+	for(auto const& [id, name] : unused) {
+		exec_id(sql_delete_list, sql_delete_list_len, path_id("tags/" + name),
+			"remove_unused_tags(delete list)");
+		exec_id(sql_delete, sql_delete_len, id, "remove_unused_tags(delete)");
+		tag_ids_.erase(name);
+		cb(name);
+	}
+	mark_path(path_id("tags"));
+}
+
+void Cache::clean() {
+	WriteLock lock(write_mutex_);
+
+	exec_or_throw("UPDATE paths SET dirty = 0 WHERE dirty", "clean(paths)");
+	exec_or_throw("UPDATE tags SET dirty = 0 WHERE dirty", "clean(tags)");
+	new_paths_.clear();
+}
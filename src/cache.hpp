@@ -2,9 +2,17 @@
 #define HEADER_CACHE_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <optional>
 #include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <sqlite3.h>
 
@@ -32,10 +40,63 @@ struct Entry {
 	std::string created;
 	std::string updated;
 	bool update;
+
+	// content hash of output file (for linked or reflinked static files
+	// "<mode>:<size>-<mtime>" of source)
+	std::string hash;
+	// mtime of output file when it was written (0 = not stored)
+	sqlite3_int64 mtime = 0;
+
+	// only for Type::Entry
+	std::string excerpt;
+	bool read_more = false;
+	std::string meta;
+};
+
+// stored state of output file
+struct OutputState {
+	std::string hash;
+	sqlite3_int64 mtime;
+
+	// only for Type::Entry, they can change without output
+	std::string excerpt;
+	bool read_more;
+	std::string meta;
 };
 
-using QueryResult = std::vector<std::string> const&;
-using QueryCallback = std::function<void(QueryResult)>;
+// failed sqlite call, thrown by all Cache methods
+class CacheError : public std::runtime_error {
+	public:
+		CacheError(std::string const& msg, int rc)
+			: std::runtime_error(msg + ": " + sqlite3_errstr(rc)), rc_(rc) {}
+
+		int code() const { return rc_; }
+	private:
+		int rc_;
+};
+
+// columns of current row of list_* query, views are valid only until
+// callback returns
+class Row {
+	public:
+		explicit Row(sqlite3_stmt* stmt) : stmt_(stmt) {}
+
+		std::string_view operator[](int col) const {
+			auto text = sqlite3_column_text(stmt_, col);
+			auto size = static_cast<size_t>(sqlite3_column_bytes(stmt_, col));
+			if(!text) {
+				return {};
+			}
+			return {reinterpret_cast<const char*>(text), size};
+		}
+		sqlite3_int64 int64(int col) const {
+			return sqlite3_column_int64(stmt_, col);
+		}
+	private:
+		sqlite3_stmt* stmt_;
+};
+
+using QueryResult = Row const&;
 
 class Cache {
 	public:
@@ -46,53 +107,254 @@ class Cache {
 		bool created() { return created_; }
 		void close();
 
+		bool journal_mode(std::string const& mode);
+		bool synchronous(std::string const& level);
+
+		// nested transactions (savepoints), outermost one is committed
+		// after every batch_size writes (0 = only on commit())
+		// writer is locked for thread which began transaction until it ends,
+		// other threads wait for it with writes (and reads without WAL)
+		void begin(std::string const& name);
+		void commit();
+		void rollback();
+		// after error, undo everything not committed yet
+		void rollback_all();
+		void batch_size(int size) { batch_size_ = size; }
+
 		sqlite3_int64 path_id(std::string const& path);
-		sqlite3_int64 tag_id(std::string const& tag);
 
+		// empty if output has no row
+		std::optional<OutputState> entry_output(Entry const& entry);
 		sqlite3_int64 add_entry(Entry const& entry);
+		// rows of one source at once, ids are in order of entries
+		std::vector<sqlite3_int64> add_entries(std::vector<Entry> entries);
 		void add_tag(sqlite3_int64 entry, std::string const& tag);
+		void set_tags(sqlite3_int64 entry, std::vector<std::string> const& tags);
 
-		void last_entries(int count, QueryCallback cb);
-		void list_subpaths(sqlite3_int64 path, QueryCallback cb);
-		void list_entries_path(sqlite3_int64 path, QueryCallback cb);
-		void list_entries_tag(sqlite3_int64 tag, QueryCallback cb);
-		void list_tags(QueryCallback cb);
+		// paths and tags whose pages are outdated by changes of entries
+		// (path "" is index, path "tags" is list of tags)
+		template<typename F>
+		void list_dirty_paths(F&& cb) {
+			Reader reader(*this);
+			list_things(list_dirty_paths_stmt(*reader.conn), cb);
+		}
+		template<typename F>
+		void list_dirty_tags(F&& cb) {
+			Reader reader(*this);
+			list_things(list_dirty_tags_stmt(*reader.conn), cb);
+		}
+		void mark_all();
+		void clean();
+
+		// values kept between runs (like hash of templates)
+		std::optional<std::string> state(std::string const& name);
+		void set_state(std::string const& name, std::string const& value);
+
+		// outputs made from source files, columns: id, type, source, path,
+		// slug, file, owner (source of markdown file attached to, NULL if it
+		// has no row, only for files) (lists, index and feed are not included)
+		template<typename F>
+		void list_sources(F&& cb) {
+			Reader reader(*this);
+			list_things(list_sources_stmt(*reader.conn), cb);
+		}
+		// outputs of markdown source including attached files,
+		// columns: id, path id, path, slug, file
+		template<typename F>
+		void list_source_outputs(std::string const& source, F&& cb) {
+			Reader reader(*this);
+			list_things(list_source_outputs_stmt(*reader.conn, source), cb);
+		}
+		// outputs of one type made from source, same columns as
+		// list_source_outputs and owner (see list_sources)
+		template<typename F>
+		void list_source_files(Type type, std::string const& source, F&& cb) {
+			Reader reader(*this);
+			list_things(list_source_files_stmt(*reader.conn, type, source), cb);
+		}
+		// forget output, pages listing it become dirty
+		void remove_entry(sqlite3_int64 id);
+		// drop tags without entries (and their pages), names are passed to cb
+		void remove_unused_tags(std::function<void(std::string const&)> cb);
+
+		template<typename F>
+		void last_entries(int count, F&& cb) {
+			Reader reader(*this);
+			list_things(last_entries_stmt(*reader.conn, count), cb);
+		}
+		template<typename F>
+		void list_subpaths(sqlite3_int64 path, F&& cb) {
+			Reader reader(*this);
+			list_things(list_subpaths_stmt(*reader.conn, path), cb);
+		}
+		template<typename F>
+		void list_entries_path(sqlite3_int64 path, F&& cb) {
+			Reader reader(*this);
+			list_things(list_entries_path_stmt(*reader.conn, path), cb);
+		}
+		// tag, path, slug, file, title, created ordered by tag
+		template<typename F>
+		void list_dirty_tag_entries(F&& cb) {
+			Reader reader(*this);
+			list_things(list_dirty_tag_entries_stmt(*reader.conn), cb);
+		}
+		template<typename F>
+		void list_tags(F&& cb) {
+			Reader reader(*this);
+			list_things(list_tags_stmt(*reader.conn), cb);
+		}
+
+		// list_* queries of other threads do not wait for transaction of
+		// writer (they see only committed rows)
+		bool parallel_reads() { return wal_; }
+
+		size_t stmt_hits() { return stmt_hits_; }
+		size_t stmt_misses() { return stmt_misses_; }
+		// read-only connections opened for list_* queries of other threads
+		size_t readers() {
+			std::lock_guard<std::mutex> lock(readers_mutex_);
+			return readers_.size();
+		}
 
 #ifdef LOG_SQL
 		void log_sql(bool value) { log_sql_ = value; }
 		bool log_sql() { return log_sql_; }
 #endif
 	private:
+		// connection with own prepared statements, used by one thread at time
+		struct Conn {
+			sqlite3* db = nullptr;
+			std::unordered_map<std::string_view, sqlite3_stmt*> stmts;
+		};
+
 		std::string path_;
-		sqlite3* db_ = nullptr;
 		bool created_ = false;
+		Conn writer_;
+		// locked by every write and for whole transaction by begin()
+		std::recursive_mutex write_mutex_;
+		std::atomic<std::thread::id> owner_;
+		// committed data can be read in parallel with writer only in WAL mode
+		std::atomic<bool> wal_{false};
+		std::vector<std::unique_ptr<Conn>> readers_;
+		std::vector<Conn*> free_readers_;
+		std::mutex readers_mutex_;
+		std::atomic<size_t> stmt_hits_{0};
+		std::atomic<size_t> stmt_misses_{0};
+		// upsert returns id and changed (sqlite 3.35+)
+		bool returning_ = sqlite3_libversion_number() >= 3035000;
+		std::vector<std::string> savepoints_;
+		int batch_size_ = 0;
+		int pending_ = 0;
+		// paths created during this run, their parents may need new list page
+		std::unordered_map<sqlite3_int64, std::string> new_paths_;
+		// name -> id of all paths and tags, filled when cache opens so
+		// lookups of known names do not need sql
+		using Ids = std::unordered_map<std::string, sqlite3_int64>;
+		Ids path_ids_;
+		Ids tag_ids_;
 #ifdef LOG_SQL
 		bool log_sql_ = false;
 #endif
 
-		void err_exit(std::string msg, int rc);
+		using WriteLock = std::lock_guard<std::recursive_mutex>;
+
+		[[noreturn]] void throw_error(std::string msg, int rc);
+#ifdef CHECK_SQL
+		void check_plan(sqlite3* db, std::string_view sql, const char* errmsg);
+#endif
 
 		bool create();
+		int schema_version();
+		std::string current_journal_mode();
+		void close_conn(Conn& conn);
 
-		void prepare_or_exit(const char* sql, int max_len,
-			sqlite3_stmt** stmt, const char** tail, const char* errmsg);
+		// connection for list_* query: writer for thread inside transaction
+		// (sees own uncommitted changes) or when not in WAL mode, otherwise
+		// read-only one from pool
+		Conn* acquire(std::unique_lock<std::recursive_mutex>& lock);
+		void release(Conn* conn);
+		struct Reader {
+			Cache& cache;
+			std::unique_lock<std::recursive_mutex> lock;
+			Conn* conn;
 
-		void bind_or_exit(sqlite3_stmt* stmt, int idx,
+			Reader(Cache& c) : cache(c), conn(c.acquire(lock)) {}
+			~Reader() { cache.release(conn); }
+		};
+
+		void exec_or_throw(std::string const& sql, const char* errmsg);
+		void batch();
+
+		sqlite3_stmt* prepare_cached(Conn& conn, const char* sql, int len,
+			const char* errmsg);
+		sqlite3_stmt* prepare_cached(const char* sql, int len,
+			const char* errmsg) {
+			return prepare_cached(writer_, sql, len, errmsg);
+		}
+
+		void bind_or_throw(sqlite3_stmt* stmt, int idx,
 			const char* value, int size, const char* errmsg);
-		void bind_or_exit(sqlite3_stmt* stmt, int idx,
+		void bind_or_throw(sqlite3_stmt* stmt, int idx,
 			std::string const& value, const char* errmsg);
-		void bind_or_exit(sqlite3_stmt* stmt, int idx,
+		void bind_or_throw(sqlite3_stmt* stmt, int idx,
 			int value, const char* errmsg);
-		void bind_or_exit(sqlite3_stmt* stmt, int idx,
+		void bind_or_throw(sqlite3_stmt* stmt, int idx,
 			sqlite3_int64 value, const char* errmsg);
 
+		void load_ids();
+
 		sqlite3_int64 get_id(
-			std::string const& name,
+			std::string const& name, Ids& ids,
 			const char* sql_insert, int sql_insert_len,
-			const char* sql_select, int sql_select_len
+			const char* sql_select, int sql_select_len,
+			bool* inserted = nullptr
 		);
 
-		void list_things(sqlite3_stmt* stmt, int count, QueryCallback cb);
+		sqlite3_int64 tag_id(std::string const& tag, bool* inserted = nullptr);
+
+		void exec_id(const char* sql, int sql_len, sqlite3_int64 id,
+			const char* errmsg);
+		// changed column of entries, see db.sql
+		enum { CHANGE_NONE, CHANGE_DATES, CHANGE_TYPE };
+		sqlite3_int64 upsert_entry(Entry const& entry, int* changed);
+		void mark_path(sqlite3_int64 path);
+		void mark_entry(Entry const& entry, sqlite3_int64 id, int changed);
+
+		// statements of list_* functions, prepared and bound
+		sqlite3_stmt* list_dirty_paths_stmt(Conn& conn);
+		sqlite3_stmt* list_dirty_tags_stmt(Conn& conn);
+		sqlite3_stmt* list_sources_stmt(Conn& conn);
+		sqlite3_stmt* list_source_outputs_stmt(Conn& conn,
+			std::string const& source);
+		sqlite3_stmt* list_source_files_stmt(Conn& conn, Type type,
+			std::string const& source);
+		sqlite3_stmt* last_entries_stmt(Conn& conn, int count);
+		sqlite3_stmt* list_subpaths_stmt(Conn& conn, sqlite3_int64 path);
+		sqlite3_stmt* list_entries_path_stmt(Conn& conn, sqlite3_int64 path);
+		sqlite3_stmt* list_dirty_tag_entries_stmt(Conn& conn);
+		sqlite3_stmt* list_tags_stmt(Conn& conn);
+
+		// calls cb with every row, no copies of columns are made
+		template<typename F>
+		void list_things(sqlite3_stmt* stmt, F& cb) {
+			// statement is reset even when cb throws
+			struct Reset {
+				sqlite3_stmt* stmt;
+				~Reset() { sqlite3_reset(stmt); }
+			} reset{stmt};
+
+			Row row(stmt);
+			while(1) {
+				int rc = sqlite3_step(stmt);
+				if(rc == SQLITE_ROW) {
+					cb(static_cast<Row const&>(row));
+				} else if(rc == SQLITE_DONE) {
+					break;
+				} else {
+					throw_error("list_things(step)", rc);
+				}
+			}
+		}
 };
 
 #endif /* HEADER_CACHE_HPP */
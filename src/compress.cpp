@@ -0,0 +1,218 @@
+#include "compress.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "hash.hpp"
+#include "mime.hpp"
+
+namespace {
+#ifdef HAVE_ZLIB
+	std::string gzip(std::string const& data, int level) {
+		z_stream zs{};
+		// 15 + 16 = max window with gzip header
+		if(deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error(fmt::format("gzip: invalid level {}", level));
+		}
+
+		std::string out;
+		out.resize(deflateBound(&zs, static_cast<uLong>(data.size())));
+		zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+		zs.avail_in = static_cast<uInt>(data.size());
+		zs.next_out = reinterpret_cast<Bytef*>(out.data());
+		zs.avail_out = static_cast<uInt>(out.size());
+
+		int rc = deflate(&zs, Z_FINISH);
+		out.resize(zs.total_out);
+		deflateEnd(&zs);
+		if(rc != Z_STREAM_END) {
+			throw std::runtime_error(fmt::format("gzip: deflate failed ({})", rc));
+		}
+		return out;
+	}
+#endif
+
+#ifdef HAVE_BROTLI
+	std::string brotli(std::string const& data, int level) {
+		std::string out;
+		size_t size = BrotliEncoderMaxCompressedSize(data.size());
+		out.resize(size ? size : data.size() + 1024);
+		size = out.size();
+		if(!BrotliEncoderCompress(level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+			data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+			&size, reinterpret_cast<uint8_t*>(out.data()))) {
+			throw std::runtime_error("brotli: compression failed");
+		}
+		out.resize(size);
+		return out;
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	std::string zstd(std::string const& data, int level) {
+		std::string out;
+		out.resize(ZSTD_compressBound(data.size()));
+		size_t size = ZSTD_compress(out.data(), out.size(),
+			data.data(), data.size(), level);
+		if(ZSTD_isError(size)) {
+			throw std::runtime_error(fmt::format("zstd: {}", ZSTD_getErrorName(size)));
+		}
+		out.resize(size);
+		return out;
+	}
+#endif
+
+	std::string compress(std::string const& format, std::string const& data,
+		miu::Config const& config) {
+#ifdef HAVE_ZLIB
+		if(format == "gz") {
+			return gzip(data, config.gzip_level);
+		}
+#endif
+#ifdef HAVE_BROTLI
+		if(format == "br") {
+			return brotli(data, config.brotli_level);
+		}
+#endif
+#ifdef HAVE_ZSTD
+		if(format == "zst") {
+			return zstd(data, config.zstd_level);
+		}
+#endif
+		(void)data;
+		(void)config;
+		throw std::runtime_error(fmt::format("unsupported format '{}'", format));
+	}
+}
+
+namespace miu {
+
+Compressor::Compressor(Config const& config) : config_(config) {
+}
+
+Compressor::~Compressor() {
+	wait();
+}
+
+bool Compressor::supported(std::string const& format) {
+#ifdef HAVE_ZLIB
+	if(format == "gz") {
+		return true;
+	}
+#endif
+#ifdef HAVE_BROTLI
+	if(format == "br") {
+		return true;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if(format == "zst") {
+		return true;
+	}
+#endif
+	(void)format;
+	return false;
+}
+
+std::vector<std::string> const& Compressor::extensions() {
+	static const std::vector<std::string> exts = {".gz", ".br", ".zst"};
+	return exts;
+}
+
+bool Compressor::wanted(fs::path const& path) const {
+	if(config_.compress.empty()) {
+		return false;
+	}
+
+	std::string type = mime_type(path);
+	for(auto const& prefix : config_.compress_types) {
+		if(type.compare(0, prefix.size(), prefix) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Compressor::add(fs::path const& path, std::string const& data) {
+	submit(path, std::make_shared<const std::string>(data));
+}
+
+void Compressor::add_file(fs::path const& path) {
+	submit(path, nullptr);
+}
+
+void Compressor::submit(fs::path const& path,
+	std::shared_ptr<const std::string> data) {
+
+	if(!pool_) {
+		pool_ = std::make_unique<Pool>(config_.jobs);
+	}
+
+	pending_.push_back(pool_->submit([this, path, data](unsigned) {
+		auto input = data;
+		if(!input) {
+			std::ifstream in(path, std::ios::binary);
+			std::stringstream ss;
+			ss << in.rdbuf();
+			input = std::make_shared<const std::string>(ss.str());
+		}
+
+		std::vector<Compressed> ret;
+		for(auto const& format : config_.compress) {
+			auto out = compress(format, *input, config_);
+
+			auto dst = path;
+			dst += "." + format;
+			auto action = fs::exists(dst) ? "update" : "create";
+
+			// gzip_static and alike may serve sibling any time, it is
+			// written next to it and renamed over it
+			auto tmp = dst;
+			tmp += ".tmp";
+			{
+				std::ofstream f(tmp, std::ios::binary);
+				f.write(out.data(), static_cast<std::streamsize>(out.size()));
+				if(!f.flush()) {
+					std::error_code ec;
+					fs::remove(tmp, ec);
+					throw std::runtime_error(fmt::format("cannot write '{}'",
+						tmp.string()));
+				}
+			}
+			fs::rename(tmp, dst);
+
+			ret.push_back({action, dst, out.size(), hash(out)});
+		}
+		return ret;
+	}));
+}
+
+std::vector<Compressed> Compressor::wait() {
+	std::vector<Compressed> ret;
+	for(auto& f : pending_) {
+		try {
+			auto done = f.get();
+			ret.insert(ret.end(), done.begin(), done.end());
+		} catch(std::exception const& e) {
+			fmt::print(stderr, "ERROR: compress: {}\n", e.what());
+		}
+	}
+	pending_.clear();
+	return ret;
+}
+
+} // namespace miu
+
@@ -0,0 +1,57 @@
+#ifndef HEADER_COMPRESS_HPP
+#define HEADER_COMPRESS_HPP
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "pool.hpp"
+
+#include "filesystem.hpp"
+
+namespace miu {
+
+// written compressed sibling of output
+struct Compressed {
+	const char* action;
+	fs::path path;
+	uintmax_t size;
+	std::string hash;
+};
+
+// writes .gz, .br and .zst next to outputs (for gzip_static and alike),
+// compression runs on worker threads, wait() collects results
+class Compressor {
+	public:
+		Compressor(Config const& config);
+		~Compressor();
+
+		Compressor(Compressor const&) = delete;
+		Compressor& operator=(Compressor const&) = delete;
+
+		// formats built in ("gz", "br", "zst")
+		static bool supported(std::string const& format);
+		// extensions of all formats (for removing siblings)
+		static std::vector<std::string> const& extensions();
+
+		// any format configured and MIME type of path matches compress_types
+		bool wanted(fs::path const& path) const;
+
+		void add(fs::path const& path, std::string const& data);
+		void add_file(fs::path const& path);
+
+		std::vector<Compressed> wait();
+	private:
+		Config const& config_;
+		std::unique_ptr<Pool> pool_;
+		std::vector<std::future<std::vector<Compressed>>> pending_;
+
+		void submit(fs::path const& path, std::shared_ptr<const std::string> data);
+};
+
+} // namespace miu
+
+#endif /* HEADER_COMPRESS_HPP */
+
@@ -1,8 +1,10 @@
 #include "config.hpp"
 #include "version.hpp"
+#include "compress.hpp"
 
 #include <cstdlib>
 #include <optional>
+#include <thread>
 
 #include "filesystem.hpp"
 
@@ -25,6 +27,7 @@ static const char* help_str = R"~(miu v{}
 
 usage:
   {} [options] [FILES...]
+  {} [options] serve
 Available options:
   -c, --conf, --config       <file>   - use this configuration file
                                         (disables searching for miu.conf)
@@ -35,6 +38,15 @@ Available options:
   -f, --files, --static      <path>   - static source directory (default: ./static)
   -t, --tmpl, --template     <path>   - directory with templates (default: ./template)
   -R, --rebuild                       - ignore cache and recreate everything
+  -W, --no-writeback                  - never rewrite front matter of sources
+  -w, --watch                         - keep running and rebuild on changes
+  -S, --serve                         - serve destination directory over HTTP
+                                        (implies --watch, same as 'serve')
+  -p, --port                 <port>   - port for --serve (default: 8080)
+  -j, --jobs                 <n>      - number of rendering threads
+                                        (default: number of CPU cores)
+  --profile                  <file>   - write timings as Chrome trace events
+                                        and print slowest files to stderr
   -v, --verbose                       - verbose output (levels: 0-2)
                                         (use multiple times to increase level)
   -V, --version                       - display version
@@ -50,6 +62,9 @@ Config::Config(int argc, char** argv) {
 		"d", "dest", "destination",
 		"f", "files", "static",
 		"t", "tmpl", "template",
+		"j", "jobs",
+		"p", "port",
+		"profile",
 	});
 
 	args.parse(argc, argv, 0
@@ -69,9 +84,12 @@ Config::Config(int argc, char** argv) {
 	auto dest = args({"destination", "dest", "d"});
 	auto static_files = args({"static", "files", "f"});
 	auto tmpl = args({"template", "tmpl", "t"});
+	auto jobs_arg = args({"jobs", "j"});
+	auto port_arg = args({"port", "p"});
+	auto profile_arg = args({"profile"});
 
 	if(args[{"help", "h", "?"}]) {
-		fmt::print(help_str, VERSION, prog);
+		fmt::print(help_str, VERSION, prog, prog);
 		std::exit(0);
 	}
 
@@ -81,8 +99,21 @@ Config::Config(int argc, char** argv) {
 	}
 
 	rebuild = args[{"rebuild", "R"}];
+	bool no_writeback = args[{"no-writeback", "W"}];
+	watch = args[{"watch", "w"}];
+	serve = args[{"serve", "S"}];
+
+	size_t first_file = 1;
+	if(args.size() > 1 && args(1).str() == "serve") {
+		serve = true;
+		first_file = 2;
+	}
+	// preview server needs outputs to follow sources
+	if(serve) {
+		watch = true;
+	}
 
-	for(size_t i=1; i<args.size(); ++i) {
+	for(size_t i=first_file; i<args.size(); ++i) {
 		files.push_back(args(i).str());
 	}
 
@@ -109,6 +140,7 @@ Config::Config(int argc, char** argv) {
 
 	if(miu_conf) {
 		if(fs::exists(*miu_conf)) {
+			config_file = fs::absolute(*miu_conf).lexically_normal().string();
 			cfg.parse_file(*miu_conf);
 		} else {
 			fmt::print(stderr, "Configuration file '{}' does not exists.\n", *miu_conf);
@@ -130,6 +162,68 @@ Config::Config(int argc, char** argv) {
 	destination_dir = cfg.get_value("destination", (root_path / "public").string());
 	static_dir = cfg.get_value("static", (root_path / "static").string());
 	template_dir = cfg.get_value("template", (root_path / "template").string());
+	// outputs changed since deploy truncated it (JSON lines), disabled when
+	// empty; hash of linked or reflinked static file is not content hash
+	// but "<static_mode>:<size>-<mtime>" of its source
+	manifest = cfg.get_value("manifest", "");
+
+	auto mtime_check_value = cfg.get_value("mtime_check", "true");
+	mtime_check = mtime_check_value != "false" && mtime_check_value != "0" &&
+		mtime_check_value != "no";
+
+	auto writeback_value = cfg.get_value("writeback", "true");
+	writeback = !no_writeback && writeback_value != "false" &&
+		writeback_value != "0" && writeback_value != "no";
+
+	auto static_mode_value = cfg.get_value("static_mode", "copy");
+	if(!parse_copy_mode(static_mode_value, static_mode)) {
+		fmt::print(stderr, "Unknown static_mode '{}' (copy, copy_file_range, "
+			"reflink, hardlink, symlink).\n", static_mode_value);
+		std::exit(1);
+	}
+
+	auto get_list = [&](const char* key, std::vector<std::string> def) {
+		auto value = cfg.get(key);
+		if(value && value->is_array) {
+			return value->values;
+		} else if(value && !value->value.empty()) {
+			return std::vector<std::string>{value->value};
+		}
+		return def;
+	};
+
+	for(auto const& format : get_list("compress", {})) {
+		if(Compressor::supported(format)) {
+			compress.push_back(format);
+		} else {
+			fmt::print(stderr, "Compression format '{}' is not supported.\n", format);
+		}
+	}
+	compress_types = get_list("compress_types", {
+		"text/", "application/atom+xml", "application/json", "image/svg+xml",
+	});
+	gzip_level = std::stoi(cfg.get_value("gzip_level", "9"));
+	brotli_level = std::stoi(cfg.get_value("brotli_level", "11"));
+	zstd_level = std::stoi(cfg.get_value("zstd_level", "19"));
+
+	// milliseconds without changes before rebuild in watch mode
+	watch_delay = std::stoi(cfg.get_value("watch_delay", "50"));
+
+	serve_host = cfg.get_value("serve_host", "127.0.0.1");
+	if(bool(port_arg)) {
+		serve_port = std::stoi(port_arg.str());
+	} else {
+		serve_port = std::stoi(cfg.get_value("serve_port", "8080"));
+	}
+
+	if(bool(profile_arg)) {
+		profile = profile_arg.str();
+	}
+	profile_top = std::stoi(cfg.get_value("profile_top", "10"));
+
+	journal_mode = cfg.get_value("journal_mode", "");
+	synchronous = cfg.get_value("synchronous", "");
+	batch_size = std::stoi(cfg.get_value("batch_size", "0"));
 
 	cfg.add("", "", "");
 	cfg.add("", "", "autogenerated:");
@@ -154,7 +248,31 @@ Config::Config(int argc, char** argv) {
 	cfg.set("tags_url", base_url + "tags/");
 
 	std::time_t ctime = std::time(nullptr);
+	// not set = number of CPU cores
+	auto jobs_value = bool(jobs_arg) ? jobs_arg.str() : cfg.get_value("jobs", "");
+	if(!jobs_value.empty()) {
+		int n = std::atoi(jobs_value.c_str());
+		if(n < 1) {
+			fmt::print(stderr, "Invalid number of jobs '{}' (must be at least 1).\n",
+				jobs_value);
+			std::exit(1);
+		}
+		jobs = static_cast<unsigned>(n);
+	} else {
+		jobs = std::thread::hardware_concurrency();
+	}
+	if(jobs == 0) {
+		jobs = 1;
+	}
+
 	cfg.set("now", fmt::format("{:%Y-%m-%dT%H:%M:%SZ}", *std::gmtime(&ctime)));
+
+	// flattened once, every rendered page starts with these values
+	cfg.each([this](kvc::KVC const& item) {
+		if(!item.is_array) {
+			site.emplace_back(item.key, item.value);
+		}
+	});
 }
 
 Config::~Config() {
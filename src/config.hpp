@@ -3,9 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 
 #include <kvc/kvc.hpp>
 
+#include "copy.hpp"
+
 namespace miu {
 
 struct Config {
@@ -13,17 +16,44 @@ struct Config {
 	~Config();
 
 	kvc::Config cfg;
+	// non-array values of cfg (site scope of templates), final after constructor
+	std::vector<std::pair<std::string, std::string>> site;
 
+	std::string config_file;
 	std::string root_dir;
 	std::string cache_db;
 	std::string source_dir;
 	std::string destination_dir;
 	std::string static_dir;
 	std::string template_dir;
+	std::string manifest;
 	std::vector<std::string> files;
 
+	std::string journal_mode;
+	std::string synchronous;
+	int batch_size = 0;
+
 	int verbose = 0;
 	bool rebuild = false;
+	bool mtime_check = true;
+	bool writeback = true;
+	CopyMode static_mode = CopyMode::Copy;
+	// formats of pre-compressed siblings ("gz", "br", "zst")
+	std::vector<std::string> compress;
+	// MIME type prefixes of outputs to compress
+	std::vector<std::string> compress_types;
+	int gzip_level = 9;
+	int brotli_level = 11;
+	int zstd_level = 19;
+	bool watch = false;
+	int watch_delay = 50;
+	bool serve = false;
+	std::string serve_host;
+	int serve_port = 8080;
+	unsigned jobs = 0;
+	// Chrome trace output, empty = profiling disabled
+	std::string profile;
+	int profile_top = 10;
 };
 
 } // namespace miu
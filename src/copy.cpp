@@ -0,0 +1,154 @@
+#include "copy.hpp"
+
+#include <cerrno>
+
+#if __has_include(<linux/fs.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#define HAVE_LINUX_FS 1
+#endif
+
+namespace {
+	struct Mode {
+		const char* name;
+		miu::CopyMode mode;
+	};
+
+	const Mode modes[] = {
+		{"copy", miu::CopyMode::Copy},
+		{"copy_file_range", miu::CopyMode::CopyFileRange},
+		{"reflink", miu::CopyMode::Reflink},
+		{"hardlink", miu::CopyMode::Hardlink},
+		{"symlink", miu::CopyMode::Symlink},
+	};
+
+#ifdef HAVE_LINUX_FS
+	class Fd {
+		public:
+			Fd(int fd) : fd_(fd) {}
+			~Fd() {
+				if(fd_ >= 0) {
+					close(fd_);
+				}
+			}
+			operator int() const { return fd_; }
+		private:
+			int fd_;
+	};
+
+	// -1 = error, 0 = not supported here, 1 = done
+	int clone_file(fs::path const& src, fs::path const& dst, bool range) {
+		Fd in(open(src.c_str(), O_RDONLY | O_CLOEXEC));
+		if(in < 0) {
+			return -1;
+		}
+		struct stat st;
+		if(fstat(in, &st) < 0) {
+			return -1;
+		}
+		Fd out(open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			st.st_mode & 07777));
+		if(out < 0) {
+			return -1;
+		}
+
+		if(!range) {
+			if(ioctl(out, FICLONE, static_cast<int>(in)) == 0) {
+				return 1;
+			}
+			return errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV ||
+				errno == EINVAL ? 0 : -1;
+		}
+
+		auto left = static_cast<size_t>(st.st_size);
+		while(left > 0) {
+			auto n = copy_file_range(in, nullptr, out, nullptr, left, 0);
+			if(n < 0) {
+				// plain copy starts over with truncated file
+				return errno == ENOSYS || errno == EOPNOTSUPP || errno == EXDEV ||
+					errno == EINVAL ? 0 : -1;
+			}
+			if(n == 0) {
+				break;
+			}
+			left -= static_cast<size_t>(n);
+		}
+		return 1;
+	}
+#endif
+}
+
+namespace miu {
+
+bool parse_copy_mode(std::string const& name, CopyMode& mode) {
+	for(auto const& m : modes) {
+		if(name == m.name) {
+			mode = m.mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* copy_mode_name(CopyMode mode) {
+	for(auto const& m : modes) {
+		if(mode == m.mode) {
+			return m.name;
+		}
+	}
+	return "";
+}
+
+bool install_file(fs::path const& src, fs::path const& dst, CopyMode& mode) {
+	// dst may be link to src from other mode, never write through it
+	std::error_code ec;
+	fs::remove(dst, ec);
+
+	switch(mode) {
+		case CopyMode::Hardlink:
+			fs::create_hard_link(src, dst, ec);
+			if(!ec) {
+				return true;
+			}
+			mode = CopyMode::Copy;
+			break;
+		case CopyMode::Symlink:
+			fs::create_symlink(fs::absolute(src), dst, ec);
+			if(!ec) {
+				return true;
+			}
+			mode = CopyMode::Copy;
+			break;
+#ifdef HAVE_LINUX_FS
+		case CopyMode::Reflink:
+			switch(clone_file(src, dst, false)) {
+				case 1: return true;
+				case -1: return false;
+			}
+			mode = CopyMode::CopyFileRange;
+			[[fallthrough]];
+		case CopyMode::CopyFileRange:
+			switch(clone_file(src, dst, true)) {
+				case 1: return true;
+				case -1: return false;
+			}
+			mode = CopyMode::Copy;
+			break;
+#else
+		case CopyMode::Reflink:
+		case CopyMode::CopyFileRange:
+			mode = CopyMode::Copy;
+			break;
+#endif
+		case CopyMode::Copy:
+			break;
+	}
+
+	return fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
+}
+
+} // namespace miu
+
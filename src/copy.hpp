@@ -0,0 +1,31 @@
+#ifndef HEADER_COPY_HPP
+#define HEADER_COPY_HPP
+
+#include <string>
+
+#include "filesystem.hpp"
+
+namespace miu {
+
+// how static files get to destination directory
+enum class CopyMode {
+	Copy,          // plain read/write copy
+	CopyFileRange, // copy_file_range(2), in kernel (may share extents)
+	Reflink,       // FICLONE, copy-on-write clone (btrfs, xfs)
+	Hardlink,
+	Symlink,
+};
+
+bool parse_copy_mode(std::string const& name, CopyMode& mode);
+const char* copy_mode_name(CopyMode mode);
+
+// replace dst with src using mode, falls back to simpler modes
+// (reflink -> copy_file_range -> copy, links -> copy) when filesystem
+// does not support it; mode is downgraded so later calls skip failing one
+// returns false if even plain copy failed
+bool install_file(fs::path const& src, fs::path const& dst, CopyMode& mode);
+
+} // namespace miu
+
+#endif /* HEADER_COPY_HPP */
+
@@ -1,8 +1,17 @@
 CREATE TABLE paths (
 	id INTEGER PRIMARY KEY ASC,
-	name TEXT UNIQUE NOT NULL
+	name TEXT UNIQUE NOT NULL,
+	-- directory containing this one (NULL for root "")
+	parent INT DEFAULT NULL,
+	-- list page needs to be regenerated
+	dirty INT NOT NULL DEFAULT 0,
+
+	FOREIGN KEY(parent) REFERENCES paths(id)
 );
 CREATE UNIQUE INDEX uniq_paths_name ON paths(name);
+CREATE INDEX paths_parent ON paths(parent);
+-- list_dirty_paths and clean
+CREATE INDEX paths_dirty ON paths(name) WHERE dirty;
 
 CREATE TABLE entries (
 	id INTEGER PRIMARY KEY ASC,
@@ -19,16 +28,39 @@ CREATE TABLE entries (
 	created TEXT NOT NULL,
 	updated TEXT DEFAULT NULL,
 
+	hash TEXT DEFAULT NULL,
+	-- mtime of output file after it was written, output with other mtime
+	-- was changed without this row (interrupted run or by hand)
+	mtime INT DEFAULT NULL,
+
+	-- rendered short version and front matter of entry for index and feed
+	excerpt TEXT DEFAULT NULL,
+	read_more INT NOT NULL DEFAULT 0,
+	meta TEXT DEFAULT NULL,
+
+	-- what last add_entry changed (0 nothing, 1 title or dates, 2 type)
+	changed INT NOT NULL DEFAULT 1,
+
 	FOREIGN KEY(path) REFERENCES paths(id),
 	UNIQUE(path, slug, file)
 );
 CREATE UNIQUE INDEX uniq_entries ON entries(path, slug, file);
+-- last_entries (index and feed) reads newest entries in index order
+CREATE INDEX entries_recent ON entries(type, IFNULL(updated, created));
+-- list_entries_path
+CREATE INDEX entries_path ON entries(path, type, created);
+-- list_source_outputs
+CREATE INDEX entries_source ON entries(source);
 
 CREATE TABLE tags (
 	id INTEGER PRIMARY KEY ASC,
-	name TEXT UNIQUE NOT NULL
+	name TEXT UNIQUE NOT NULL,
+	-- tag page needs to be regenerated
+	dirty INT NOT NULL DEFAULT 0
 );
 CREATE UNIQUE INDEX uniq_tags_name ON tags(name);
+-- list_dirty_tags and clean
+CREATE INDEX tags_dirty ON tags(name) WHERE dirty;
 
 CREATE TABLE tagged_entries (
 	tag INT NOT NULL,
@@ -39,4 +71,12 @@ CREATE TABLE tagged_entries (
 	UNIQUE(tag, entry)
 );
 CREATE UNIQUE INDEX uniq_tag_entry ON tagged_entries(tag, entry);
+-- tags of entry (set_tags, mark_entry, remove_entry)
+CREATE INDEX tagged_entries_entry ON tagged_entries(entry, tag);
+
+-- values kept between runs
+CREATE TABLE state (
+	name TEXT PRIMARY KEY,
+	value TEXT NOT NULL
+);
 
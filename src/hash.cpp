@@ -0,0 +1,153 @@
+#include "hash.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include <fmt/core.h>
+
+namespace {
+	constexpr uint64_t P1 = 11400714785074694791ULL;
+	constexpr uint64_t P2 = 14029467366897019727ULL;
+	constexpr uint64_t P3 = 1609587929392839161ULL;
+	constexpr uint64_t P4 = 9650029242287828579ULL;
+	constexpr uint64_t P5 = 2870177450012600261ULL;
+
+	inline uint64_t rotl(uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	// little endian reads
+	inline uint64_t read64(const unsigned char* p) {
+		uint64_t v = 0;
+		for(int i=7; i>=0; --i) {
+			v = (v << 8) | p[i];
+		}
+		return v;
+	}
+
+	inline uint32_t read32(const unsigned char* p) {
+		uint32_t v = 0;
+		for(int i=3; i>=0; --i) {
+			v = (v << 8) | p[i];
+		}
+		return v;
+	}
+
+	inline uint64_t round(uint64_t acc, uint64_t input) {
+		acc += input * P2;
+		acc = rotl(acc, 31);
+		return acc * P1;
+	}
+
+	inline uint64_t merge_round(uint64_t acc, uint64_t val) {
+		acc ^= round(0, val);
+		return acc * P1 + P4;
+	}
+}
+
+namespace miu {
+
+Hash::Hash(uint64_t seed) : seed_(seed) {
+	v_[0] = seed + P1 + P2;
+	v_[1] = seed + P2;
+	v_[2] = seed;
+	v_[3] = seed - P1;
+}
+
+void Hash::update(const char* data, size_t size) {
+	auto p = reinterpret_cast<const unsigned char*>(data);
+	auto const end = p + size;
+	total_ += size;
+
+	if(buf_size_ + size < 32) {
+		std::memcpy(buf_ + buf_size_, p, size);
+		buf_size_ += size;
+		return;
+	}
+
+	if(buf_size_) {
+		auto n = 32 - buf_size_;
+		std::memcpy(buf_ + buf_size_, p, n);
+		for(int i=0; i<4; ++i) {
+			v_[i] = round(v_[i], read64(buf_ + i*8));
+		}
+		p += n;
+		buf_size_ = 0;
+	}
+
+	while(end - p >= 32) {
+		for(int i=0; i<4; ++i) {
+			v_[i] = round(v_[i], read64(p + i*8));
+		}
+		p += 32;
+	}
+
+	buf_size_ = static_cast<size_t>(end - p);
+	std::memcpy(buf_, p, buf_size_);
+}
+
+uint64_t Hash::digest() const {
+	uint64_t h;
+
+	if(total_ >= 32) {
+		h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+		for(int i=0; i<4; ++i) {
+			h = merge_round(h, v_[i]);
+		}
+	} else {
+		h = seed_ + P5;
+	}
+
+	h += total_;
+
+	auto p = buf_;
+	auto const end = buf_ + buf_size_;
+	while(end - p >= 8) {
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * P1 + P4;
+		p += 8;
+	}
+	if(end - p >= 4) {
+		h ^= static_cast<uint64_t>(read32(p)) * P1;
+		h = rotl(h, 23) * P2 + P3;
+		p += 4;
+	}
+	while(p < end) {
+		h ^= *p * P5;
+		h = rotl(h, 11) * P1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+std::string Hash::hex() const {
+	return fmt::format("{:016x}", digest());
+}
+
+
+std::string hash(std::string_view data) {
+	Hash h;
+	h.update(data);
+	return h.hex();
+}
+
+std::string hash_file(fs::path const& path) {
+	std::ifstream in(path, std::ios::binary);
+	Hash h;
+	char buf[64 * 1024];
+	while(in) {
+		in.read(buf, sizeof(buf));
+		h.update(buf, static_cast<size_t>(in.gcount()));
+	}
+	return h.hex();
+}
+
+} // namespace miu
+
@@ -0,0 +1,37 @@
+#ifndef HEADER_HASH_HPP
+#define HEADER_HASH_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "filesystem.hpp"
+
+namespace miu {
+
+// streaming XXH64 (https://github.com/Cyan4973/xxHash)
+class Hash {
+	public:
+		Hash(uint64_t seed = 0);
+
+		void update(const char* data, size_t size);
+		void update(std::string_view data) { update(data.data(), data.size()); }
+
+		uint64_t digest() const;
+		// digest as 16 hex digits
+		std::string hex() const;
+	private:
+		uint64_t v_[4];
+		uint64_t seed_;
+		uint64_t total_ = 0;
+		unsigned char buf_[32];
+		size_t buf_size_ = 0;
+};
+
+std::string hash(std::string_view data);
+std::string hash_file(fs::path const& path);
+
+} // namespace miu
+
+#endif /* HEADER_HASH_HPP */
+
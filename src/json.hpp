@@ -0,0 +1,31 @@
+#ifndef HEADER_JSON_HPP
+#define HEADER_JSON_HPP
+
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+namespace miu {
+
+// escape string for use inside JSON double quotes
+inline std::string json_escape(std::string_view str) {
+	std::string ret;
+	ret.reserve(str.size());
+	for(char c : str) {
+		if(c == '"' || c == '\\') {
+			ret += '\\';
+			ret += c;
+		} else if(static_cast<unsigned char>(c) < 0x20) {
+			ret += fmt::format("\\u{:04x}", static_cast<int>(c));
+		} else {
+			ret += c;
+		}
+	}
+	return ret;
+}
+
+} // namespace miu
+
+#endif /* HEADER_JSON_HPP */
+
@@ -0,0 +1,29 @@
+#ifndef HEADER_LOG_HPP
+#define HEADER_LOG_HPP
+
+#include <fmt/core.h>
+
+#include "filesystem.hpp"
+
+// used inside App methods (needs config_)
+#define LOG_INFO(...) do { if(config_.verbose > 0) fmt::print(__VA_ARGS__); } while(0)
+#define LOG_TRACE(...) do { if(config_.verbose > 1) fmt::print(__VA_ARGS__); } while(0)
+#define LOG_ERROR(...) do { fmt::print(stderr, __VA_ARGS__); } while(0)
+
+// formatter for fs::path
+// because using fmt/ostream.h would surround path with quotes
+namespace fmt {
+template <>
+struct formatter<fs::path> {
+	template <typename ParseContext>
+	constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+	template <typename FormatContext>
+	auto format(fs::path const& p, FormatContext &ctx) {
+		return format_to(ctx.out(), "{}", p.string());
+	}
+};
+}
+
+#endif /* HEADER_LOG_HPP */
+
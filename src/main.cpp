@@ -1,8 +1,14 @@
 #include "app.hpp"
 
+#include <fmt/core.h>
+
 int main(int argc, char** argv) {
-	miu::App app(argc, argv);
+	try {
+		miu::App app(argc, argv);
 
-	return app.run();
+		return app.run();
+	} catch(CacheError const& e) {
+		fmt::print(stderr, "SQLITE ERROR({}): {}\n", e.code(), e.what());
+		return 1;
+	}
 }
-
@@ -0,0 +1,40 @@
+#include "mime.hpp"
+
+#include <cctype>
+#include <string>
+#include <unordered_map>
+
+namespace miu {
+
+const char* mime_type(fs::path const& path) {
+	static const std::unordered_map<std::string, const char*> types = {
+		{".html", "text/html; charset=utf-8"},
+		{".htm", "text/html; charset=utf-8"},
+		{".xml", "application/atom+xml; charset=utf-8"},
+		{".css", "text/css; charset=utf-8"},
+		{".js", "text/javascript; charset=utf-8"},
+		{".json", "application/json"},
+		{".txt", "text/plain; charset=utf-8"},
+		{".md", "text/plain; charset=utf-8"},
+		{".svg", "image/svg+xml"},
+		{".png", "image/png"},
+		{".jpg", "image/jpeg"},
+		{".jpeg", "image/jpeg"},
+		{".gif", "image/gif"},
+		{".webp", "image/webp"},
+		{".ico", "image/x-icon"},
+		{".woff", "font/woff"},
+		{".woff2", "font/woff2"},
+		{".pdf", "application/pdf"},
+	};
+
+	auto ext = path.extension().string();
+	for(auto& c : ext) {
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+	auto it = types.find(ext);
+	return it != types.end() ? it->second : "application/octet-stream";
+}
+
+} // namespace miu
+
@@ -0,0 +1,14 @@
+#ifndef HEADER_MIME_HPP
+#define HEADER_MIME_HPP
+
+#include "filesystem.hpp"
+
+namespace miu {
+
+// MIME type (with charset for text) guessed from extension
+const char* mime_type(fs::path const& path);
+
+} // namespace miu
+
+#endif /* HEADER_MIME_HPP */
+
@@ -0,0 +1,84 @@
+#ifndef HEADER_POOL_HPP
+#define HEADER_POOL_HPP
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace miu {
+
+// fixed size pool of worker threads
+// tasks are called with index of worker that runs them (0..size()-1)
+// so callers can keep per worker state (e.g. templates) without locking
+class Pool {
+	public:
+		Pool(unsigned jobs) {
+			if(jobs == 0) {
+				jobs = 1;
+			}
+			for(unsigned i=0; i<jobs; ++i) {
+				workers_.emplace_back([this, i]() { work(i); });
+			}
+		}
+
+		~Pool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = true;
+			}
+			cv_.notify_all();
+			for(auto& w : workers_) {
+				w.join();
+			}
+		}
+
+		Pool(Pool const&) = delete;
+		Pool& operator=(Pool const&) = delete;
+
+		unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+		template<typename F>
+		auto submit(F&& f) -> std::future<decltype(f(0u))> {
+			using R = decltype(f(0u));
+			auto task = std::make_shared<std::packaged_task<R(unsigned)>>(
+				std::forward<F>(f));
+			auto ret = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				queue_.emplace_back([task](unsigned worker) { (*task)(worker); });
+			}
+			cv_.notify_one();
+			return ret;
+		}
+	private:
+		std::vector<std::thread> workers_;
+		std::deque<std::function<void(unsigned)>> queue_;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool stop_ = false;
+
+		void work(unsigned worker) {
+			while(1) {
+				std::function<void(unsigned)> task;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					cv_.wait(lock, [this]{ return stop_ || !queue_.empty(); });
+					if(queue_.empty()) {
+						return;
+					}
+					task = std::move(queue_.front());
+					queue_.pop_front();
+				}
+				task(worker);
+			}
+		}
+};
+
+} // namespace miu
+
+#endif /* HEADER_POOL_HPP */
+
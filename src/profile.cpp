@@ -0,0 +1,132 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "json.hpp"
+
+namespace miu {
+
+Profiler::Scope::Scope(Profiler* profiler, const char* cat, const char* name,
+	std::string file)
+	: profiler_(profiler && profiler->enabled() ? profiler : nullptr),
+	cat_(cat), name_(name), file_(std::move(file)) {
+
+	if(profiler_) {
+		start_ = clock::now();
+	}
+}
+
+void Profiler::Scope::next(const char* name) {
+	if(!profiler_) {
+		return;
+	}
+	auto now = clock::now();
+	profiler_->add(cat_, name_, file_, start_, now);
+	name_ = name;
+	start_ = now;
+}
+
+void Profiler::Scope::stop() {
+	if(!profiler_) {
+		return;
+	}
+	profiler_->add(cat_, name_, file_, start_, clock::now());
+	profiler_ = nullptr;
+}
+
+
+void Profiler::enable() {
+	enabled_ = true;
+	start_ = clock::now();
+}
+
+void Profiler::add(const char* cat, const char* name, std::string const& file,
+	clock::time_point start, clock::time_point end) {
+
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto tid = threads_.emplace(std::this_thread::get_id(),
+		static_cast<unsigned>(threads_.size())).first->second;
+	events_.push_back({cat, name, file,
+		duration_cast<microseconds>(start - start_).count(),
+		duration_cast<microseconds>(end - start).count(),
+		tid});
+}
+
+bool Profiler::write(std::string const& path) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::ofstream out(path);
+	if(!out) {
+		return false;
+	}
+
+	out << "{\"traceEvents\":[\n";
+	for(auto const& tid : threads_) {
+		out << fmt::format(R"~({{"name":"thread_name","ph":"M","pid":1,"tid":{},)~"
+			R"~("args":{{"name":"{}"}}}},)~" "\n",
+			tid.second, tid.second ? fmt::format("worker {}", tid.second) : "main");
+	}
+	bool first = true;
+	for(auto const& e : events_) {
+		if(!first) {
+			out << ",\n";
+		}
+		first = false;
+		out << fmt::format(R"~({{"name":"{}","cat":"{}","ph":"X","ts":{},"dur":{},)~"
+			R"~("pid":1,"tid":{})~", e.name, e.cat, e.ts, e.dur, e.tid);
+		if(!e.file.empty()) {
+			out << fmt::format(R"~(,"args":{{"file":"{}"}})~", json_escape(e.file));
+		}
+		out << "}";
+	}
+	out << "\n]}\n";
+
+	return bool(out);
+}
+
+void Profiler::summary(size_t n) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::vector<std::pair<std::string, long long>> phases;
+	std::unordered_map<std::string, long long> files;
+	for(auto const& e : events_) {
+		if(std::string_view(e.cat) == "phase") {
+			auto it = std::find_if(phases.begin(), phases.end(),
+				[&](auto const& p) { return p.first == e.name; });
+			if(it == phases.end()) {
+				phases.emplace_back(e.name, e.dur);
+			} else {
+				it->second += e.dur;
+			}
+		} else if(std::string_view(e.cat) == "file") {
+			files[e.file] += e.dur;
+		}
+	}
+
+	fmt::print(stderr, "PROFILE: phases:\n");
+	for(auto const& [name, dur] : phases) {
+		fmt::print(stderr, "  {:10.3f} ms  {}\n", static_cast<double>(dur) / 1000.0, name);
+	}
+
+	std::vector<std::pair<std::string, long long>> slowest(files.begin(), files.end());
+	n = std::min(n, slowest.size());
+	std::partial_sort(slowest.begin(), slowest.begin() + static_cast<long>(n),
+		slowest.end(), [](auto const& a, auto const& b) { return a.second > b.second; });
+
+	fmt::print(stderr, "PROFILE: {} slowest files:\n", n);
+	for(size_t i=0; i<n; ++i) {
+		fmt::print(stderr, "  {:10.3f} ms  {}\n",
+			static_cast<double>(slowest[i].second) / 1000.0, slowest[i].first);
+	}
+}
+
+} // namespace miu
+
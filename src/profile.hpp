@@ -0,0 +1,78 @@
+#ifndef HEADER_PROFILE_HPP
+#define HEADER_PROFILE_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+namespace miu {
+
+// wall time of build steps saved as Chrome trace events
+// (chrome://tracing, ui.perfetto.dev), can be used from worker threads
+class Profiler {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		// measures time until destroyed (or stop()/next())
+		class Scope {
+			public:
+				Scope(Profiler* profiler, const char* cat, const char* name,
+					std::string file);
+				~Scope() { stop(); }
+
+				Scope(Scope const&) = delete;
+				Scope& operator=(Scope const&) = delete;
+
+				// end this step and start following one
+				void next(const char* name);
+				void stop();
+			private:
+				Profiler* profiler_;
+				const char* cat_;
+				const char* name_;
+				std::string file_;
+				clock::time_point start_;
+		};
+
+		void enable();
+		bool enabled() const { return enabled_; }
+
+		// build phase (process_static, process_source, ...)
+		Scope phase(const char* name) { return {this, "phase", name, {}}; }
+		// work done for one file, summed per file for summary
+		Scope file(const char* name, std::string const& file) {
+			return {this, "file", name, file};
+		}
+		// part of file or phase (read, parse, make, write, sql, ...)
+		Scope step(const char* name) { return {this, "step", name, {}}; }
+
+		bool write(std::string const& path);
+		// phase times and n slowest files to stderr
+		void summary(size_t n);
+	private:
+		struct Event {
+			const char* cat;
+			const char* name;
+			std::string file;
+			long long ts;
+			long long dur;
+			unsigned tid;
+		};
+
+		bool enabled_ = false;
+		clock::time_point start_;
+		std::mutex mutex_;
+		std::vector<Event> events_;
+		std::unordered_map<std::thread::id, unsigned> threads_;
+
+		void add(const char* cat, const char* name, std::string const& file,
+			clock::time_point start, clock::time_point end);
+};
+
+} // namespace miu
+
+#endif /* HEADER_PROFILE_HPP */
+
@@ -0,0 +1,476 @@
+#include "server.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+#include <fmt/core.h>
+
+#if __has_include(<sys/epoll.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#define HAVE_EPOLL 1
+#endif
+
+#include "hash.hpp"
+#include "mime.hpp"
+
+namespace {
+	// decode %XX, drop query, reject anything escaping root
+	bool normalize_url(std::string const& target, std::string& url) {
+		url.clear();
+		auto end = target.find_first_of("?#");
+		if(end == std::string::npos) {
+			end = target.size();
+		}
+		for(size_t i=0; i<end; ++i) {
+			char c = target[i];
+			if(c == '%' && i + 2 < end &&
+				std::isxdigit(static_cast<unsigned char>(target[i+1])) &&
+				std::isxdigit(static_cast<unsigned char>(target[i+2]))) {
+				c = static_cast<char>(std::stoi(target.substr(i+1, 2), nullptr, 16));
+				i += 2;
+			}
+			url += c;
+		}
+
+		if(url.empty() || url[0] != '/') {
+			return false;
+		}
+		for(auto const& part : fs::path(url)) {
+			if(part == "..") {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const char* status_text(int status) {
+		switch(status) {
+			case 200: return "OK";
+			case 301: return "Moved Permanently";
+			case 304: return "Not Modified";
+			case 400: return "Bad Request";
+			case 404: return "Not Found";
+			case 405: return "Method Not Allowed";
+		}
+		return "Internal Server Error";
+	}
+}
+
+namespace miu {
+
+Server::Server(std::string root, std::string host, int port)
+	: root_(root), host_(host), port_(port) {
+}
+
+Server::~Server() {
+	stop();
+}
+
+std::string Server::key(fs::path const& file) {
+	return "/" + file.lexically_relative(root_).generic_string();
+}
+
+Server::Page::~Page() {
+#ifdef HAVE_EPOLL
+	if(fd >= 0) {
+		close(fd);
+	}
+#endif
+}
+
+void Server::publish(fs::path const& file, std::string const& data) {
+	auto page = std::make_shared<Page>();
+	page->data = data;
+	page->etag = "\"" + hash(data) + "\"";
+	page->type = mime_type(file);
+	page->size = data.size();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	pages_[key(file)] = page;
+}
+
+void Server::invalidate(fs::path const& file) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	pages_.erase(key(file));
+}
+
+std::shared_ptr<const Server::Page> Server::page(std::string const& url) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = pages_.find(url);
+		if(it != pages_.end()) {
+			return it->second;
+		}
+	}
+
+#ifdef HAVE_EPOLL
+	// nothing is read here, opened file is sent by flush() (file replaced
+	// meanwhile is sent as it was when opened)
+	auto path = fs::path(root_) / url.substr(1);
+	auto page = std::make_shared<Page>();
+	page->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if(page->fd < 0 || fstat(page->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		return nullptr;
+	}
+	page->size = static_cast<size_t>(st.st_size);
+	page->etag = fmt::format("\"{:x}-{:x}.{:x}\"", page->size,
+		static_cast<uint64_t>(st.st_mtim.tv_sec),
+		static_cast<uint64_t>(st.st_mtim.tv_nsec));
+	page->type = mime_type(url);
+
+	return page;
+#else
+	return nullptr;
+#endif
+}
+
+#ifdef HAVE_EPOLL
+
+bool Server::start() {
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listen_fd_ < 0) {
+		error_ = fmt::format("socket: {}", std::strerror(errno));
+		return false;
+	}
+
+	int one = 1;
+	setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<uint16_t>(port_));
+	if(inet_pton(AF_INET, host_.c_str(), &addr.sin_addr) != 1) {
+		error_ = fmt::format("invalid address '{}'", host_);
+		return false;
+	}
+	if(bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+		listen(listen_fd_, SOMAXCONN) < 0) {
+		error_ = fmt::format("{}:{}: {}", host_, port_, std::strerror(errno));
+		return false;
+	}
+
+	epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(epoll_fd_ < 0 || wake_fd_ < 0) {
+		error_ = fmt::format("epoll: {}", std::strerror(errno));
+		return false;
+	}
+
+	epoll_event ev{};
+	ev.events = EPOLLIN;
+	ev.data.fd = listen_fd_;
+	epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+	ev.data.fd = wake_fd_;
+	epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+	thread_ = std::thread([this]() { loop(); });
+	return true;
+}
+
+void Server::stop() {
+	if(thread_.joinable()) {
+		uint64_t one = 1;
+		auto rc = write(wake_fd_, &one, sizeof(one));
+		(void)rc;
+		thread_.join();
+	}
+	for(int* fd : {&listen_fd_, &epoll_fd_, &wake_fd_}) {
+		if(*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+void Server::loop() {
+	std::unordered_map<int, Connection> conns;
+	epoll_event events[256];
+	char buf[64 * 1024];
+
+	auto drop = [&](int fd) {
+		epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+		close(fd);
+		conns.erase(fd);
+	};
+
+	while(1) {
+		int n = epoll_wait(epoll_fd_, events, 256, -1);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		for(int i=0; i<n; ++i) {
+			int fd = events[i].data.fd;
+
+			if(fd == wake_fd_) {
+				for(auto& c : conns) {
+					close(c.first);
+				}
+				return;
+			}
+
+			if(fd == listen_fd_) {
+				while(1) {
+					int cfd = accept4(listen_fd_, nullptr, nullptr,
+						SOCK_NONBLOCK | SOCK_CLOEXEC);
+					if(cfd < 0) {
+						break;
+					}
+					int one = 1;
+					setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+					epoll_event ev{};
+					ev.events = EPOLLIN | EPOLLRDHUP;
+					ev.data.fd = cfd;
+					epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, cfd, &ev);
+					conns[cfd];
+				}
+				continue;
+			}
+
+			auto it = conns.find(fd);
+			if(it == conns.end()) {
+				continue;
+			}
+			auto& c = it->second;
+
+			if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+				drop(fd);
+				continue;
+			}
+
+			if(events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+				bool eof = false;
+				while(1) {
+					auto r = read(fd, buf, sizeof(buf));
+					if(r > 0) {
+						c.in.append(buf, static_cast<size_t>(r));
+					} else {
+						eof = r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+						break;
+					}
+				}
+				handle(c);
+				if(eof) {
+					c.close = true;
+				}
+			}
+
+			bool pending = flush(fd, c);
+			if(!pending && c.close) {
+				drop(fd);
+				continue;
+			}
+
+			epoll_event ev{};
+			ev.events = 0;
+			if(!c.close) {
+				ev.events |= EPOLLIN | EPOLLRDHUP;
+			}
+			if(pending) {
+				ev.events |= EPOLLOUT;
+			}
+			ev.data.fd = fd;
+			epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+		}
+	}
+}
+
+// write as much as possible, returns true when something is left
+bool Server::flush(int fd, Connection& c) {
+	while(!c.out.empty()) {
+		auto& o = c.out.front();
+
+		size_t body_size = o.body ? o.body->size : 0;
+		size_t body_pos = o.pos > o.head.size() ? o.pos - o.head.size() : 0;
+		ssize_t w = 0;
+		if(o.pos >= o.head.size() && o.body && o.body->fd >= 0) {
+			// file goes from page cache to socket without copying
+			if(body_pos < body_size) {
+				auto off = static_cast<off_t>(body_pos);
+				w = sendfile(fd, o.body->fd, &off, body_size - body_pos);
+				if(w == 0) {
+					// file got shorter, response cannot be completed
+					c.out.clear();
+					c.close = true;
+					return false;
+				}
+			}
+		} else {
+			iovec iov[2];
+			int cnt = 0;
+			if(o.pos < o.head.size()) {
+				iov[cnt].iov_base = const_cast<char*>(o.head.data() + o.pos);
+				iov[cnt].iov_len = o.head.size() - o.pos;
+				++cnt;
+			}
+			if(o.body && o.body->fd < 0 && body_pos < body_size) {
+				iov[cnt].iov_base = const_cast<char*>(o.body->data.data() + body_pos);
+				iov[cnt].iov_len = body_size - body_pos;
+				++cnt;
+			}
+			if(cnt) {
+				w = writev(fd, iov, cnt);
+			}
+		}
+
+		if(w < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			c.out.clear();
+			c.close = true;
+			return false;
+		}
+		o.pos += static_cast<size_t>(w);
+
+		if(o.pos >= o.head.size() + body_size) {
+			c.out.pop_front();
+		}
+	}
+	return false;
+}
+
+#else
+
+bool Server::start() {
+	error_ = "not supported on this platform";
+	return false;
+}
+
+void Server::stop() {
+}
+
+#endif
+
+// parse complete requests from c.in and queue responses
+void Server::handle(Connection& c) {
+	while(!c.close) {
+		auto end = c.in.find("\r\n\r\n");
+		if(end == std::string::npos) {
+			return;
+		}
+		std::string request = c.in.substr(0, end);
+		c.in.erase(0, end + 4);
+
+		std::istringstream lines(request);
+		std::string line;
+		std::getline(lines, line);
+		if(!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		std::istringstream first(line);
+		std::string method, target, version;
+		first >> method >> target >> version;
+
+		bool keep_alive = version == "HTTP/1.1";
+		std::string if_none_match;
+		size_t content_length = 0;
+		while(std::getline(lines, line)) {
+			if(!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			auto colon = line.find(':');
+			if(colon == std::string::npos) {
+				continue;
+			}
+			auto name = line.substr(0, colon);
+			for(auto& ch : name) {
+				ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+			}
+			auto start = line.find_first_not_of(" \t", colon + 1);
+			auto value = start == std::string::npos ? "" : line.substr(start);
+
+			if(name == "if-none-match") {
+				if_none_match = value;
+			} else if(name == "connection") {
+				for(auto& ch : value) {
+					ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+				}
+				if(value == "close") {
+					keep_alive = false;
+				} else if(value == "keep-alive") {
+					keep_alive = true;
+				}
+			} else if(name == "content-length") {
+				content_length = std::strtoul(value.c_str(), nullptr, 10);
+			}
+		}
+
+		int status = 200;
+		std::string extra;
+		std::shared_ptr<const Page> body;
+		std::string url;
+
+		if(version.rfind("HTTP/1.", 0) != 0 || !normalize_url(target, url) ||
+			content_length) {
+			status = 400;
+			keep_alive = false;
+		} else if(method != "GET" && method != "HEAD") {
+			status = 405;
+			extra = "Allow: GET, HEAD\r\n";
+		} else {
+			if(url.back() == '/') {
+				url += "index.html";
+			}
+			body = page(url);
+			if(!body && fs::is_directory(fs::path(root_) / url.substr(1))) {
+				status = 301;
+				extra = fmt::format("Location: {}/\r\n", url);
+			} else if(!body) {
+				status = 404;
+			} else if(!if_none_match.empty() && if_none_match == body->etag) {
+				status = 304;
+			}
+		}
+
+		if(status != 200) {
+			auto etag = status == 304 ? body->etag : "";
+			body.reset();
+			if(!etag.empty()) {
+				extra = "ETag: " + etag + "\r\n";
+			}
+		}
+
+		Output o;
+		size_t size = body ? body->size : 0;
+		o.head = fmt::format("HTTP/1.1 {} {}\r\n", status, status_text(status));
+		if(body) {
+			o.head += fmt::format("Content-Type: {}\r\nETag: {}\r\n",
+				body->type, body->etag);
+		}
+		o.head += extra;
+		o.head += fmt::format("Content-Length: {}\r\nConnection: {}\r\n"
+			"Cache-Control: no-cache\r\n\r\n",
+			size, keep_alive ? "keep-alive" : "close");
+		if(method != "HEAD") {
+			o.body = body;
+		}
+		c.out.push_back(std::move(o));
+
+		if(!keep_alive) {
+			c.close = true;
+		}
+	}
+}
+
+} // namespace miu
+
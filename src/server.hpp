@@ -0,0 +1,84 @@
+#ifndef HEADER_SERVER_HPP
+#define HEADER_SERVER_HPP
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "filesystem.hpp"
+
+namespace miu {
+
+// minimal HTTP/1.1 server (GET/HEAD, keep-alive, ETag) for previewing
+// destination directory, pages published by App are served from memory,
+// other files are sent from disk with sendfile (ETag of size and mtime)
+class Server {
+	public:
+		Server(std::string root, std::string host, int port);
+		~Server();
+
+		Server(Server const&) = delete;
+		Server& operator=(Server const&) = delete;
+
+		// bind and start serving in background thread
+		bool start();
+		void stop();
+		std::string const& error() const { return error_; }
+
+		void publish(fs::path const& file, std::string const& data);
+		void invalidate(fs::path const& file);
+	private:
+		struct Page {
+			std::string data;
+			std::string etag;
+			const char* type;
+			// file sent from disk instead of data, closed with page
+			int fd = -1;
+			size_t size = 0;
+
+			Page() = default;
+			Page(Page const&) = delete;
+			Page& operator=(Page const&) = delete;
+			~Page();
+		};
+
+		struct Output {
+			std::string head;
+			std::shared_ptr<const Page> body;
+			size_t pos = 0;
+		};
+
+		struct Connection {
+			std::string in;
+			std::deque<Output> out;
+			bool close = false;
+		};
+
+		std::string root_;
+		std::string host_;
+		int port_;
+		std::string error_;
+
+		int listen_fd_ = -1;
+		int epoll_fd_ = -1;
+		int wake_fd_ = -1;
+		std::thread thread_;
+
+		std::mutex mutex_;
+		std::unordered_map<std::string, std::shared_ptr<const Page>> pages_;
+
+		std::string key(fs::path const& file);
+		std::shared_ptr<const Page> page(std::string const& url);
+
+		void loop();
+		void handle(Connection& c);
+		bool flush(int fd, Connection& c);
+};
+
+} // namespace miu
+
+#endif /* HEADER_SERVER_HPP */
+
@@ -0,0 +1,318 @@
+#include "app.hpp"
+
+#include <set>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#if __has_include(<sys/inotify.h>)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#define HAVE_INOTIFY 1
+#endif
+
+#include "log.hpp"
+
+namespace {
+	bool is_under(fs::path const& path, std::string const& dir) {
+		auto rel = path.lexically_relative(dir);
+		return !rel.empty() && *rel.begin() != "..";
+	}
+
+#ifdef HAVE_INOTIFY
+	const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+		IN_CREATE | IN_DELETE;
+
+	class Watcher {
+		public:
+			Watcher() {
+				fd_ = inotify_init1(IN_CLOEXEC);
+			}
+
+			~Watcher() {
+				if(fd_ >= 0) {
+					close(fd_);
+				}
+			}
+
+			int fd() const { return fd_; }
+
+			void add(fs::path const& dir, bool recursive) {
+				if(!fs::is_directory(dir)) {
+					return;
+				}
+				int wd = inotify_add_watch(fd_, dir.c_str(), watch_mask);
+				if(wd >= 0) {
+					dirs_[wd] = dir;
+				}
+				if(recursive) {
+					for(auto const& p : fs::recursive_directory_iterator(dir)) {
+						if(p.is_directory()) {
+							wd = inotify_add_watch(fd_, p.path().c_str(), watch_mask);
+							if(wd >= 0) {
+								dirs_[wd] = p.path();
+							}
+						}
+					}
+				}
+			}
+
+			// watch only one file in its directory, other files there (like
+			// cache journal or manifest next to miu.conf) are ignored
+			void add_file(fs::path const& file) {
+				auto dir = file.parent_path();
+				if(dir.empty()) {
+					dir = ".";
+				}
+				if(!fs::is_directory(dir)) {
+					return;
+				}
+				int wd = inotify_add_watch(fd_, dir.c_str(), watch_mask);
+				// directory watched whole already
+				if(wd < 0 || dirs_.count(wd)) {
+					return;
+				}
+				dirs_[wd] = dir;
+				files_[wd] = file;
+			}
+
+			// wait for timeout_ms (-1 = forever), append changed files
+			// returns false on timeout
+			bool read(int timeout_ms, std::set<fs::path>& changed) {
+				struct pollfd pfd = { fd_, POLLIN, 0 };
+				if(poll(&pfd, 1, timeout_ms) <= 0) {
+					return false;
+				}
+
+				alignas(struct inotify_event) char buf[64 * 1024];
+				auto n = ::read(fd_, buf, sizeof(buf));
+				if(n <= 0) {
+					return false;
+				}
+
+				for(char* p = buf; p < buf + n; ) {
+					auto ev = reinterpret_cast<struct inotify_event*>(p);
+					p += sizeof(struct inotify_event) + ev->len;
+
+					if(ev->mask & IN_IGNORED) {
+						dirs_.erase(ev->wd);
+						files_.erase(ev->wd);
+						continue;
+					}
+					auto it = dirs_.find(ev->wd);
+					if(it == dirs_.end() || ev->len == 0) {
+						continue;
+					}
+
+					if(auto file = files_.find(ev->wd); file != files_.end()) {
+						if(file->second.filename() == ev->name) {
+							changed.insert(file->second);
+						}
+						continue;
+					}
+
+					auto path = it->second / ev->name;
+					if(ev->mask & IN_ISDIR) {
+						// new directory, watch it and take everything in it
+						if(ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+							add(path, true);
+							for(auto const& f : fs::recursive_directory_iterator(path)) {
+								if(f.is_regular_file()) {
+									changed.insert(f.path());
+								}
+							}
+						}
+						continue;
+					}
+					// written by process_mkd before rename
+					if(path.extension() == ".tmp") {
+						continue;
+					}
+					changed.insert(path);
+				}
+
+				return true;
+			}
+		private:
+			int fd_ = -1;
+			std::unordered_map<int, fs::path> dirs_;
+			std::unordered_map<int, fs::path> files_;
+	};
+#endif
+}
+
+namespace miu {
+
+int App::watch() {
+#ifdef HAVE_INOTIFY
+	Watcher watcher;
+	if(watcher.fd() < 0) {
+		LOG_ERROR("ERROR: inotify_init failed\n");
+		return 1;
+	}
+
+	watcher.add(config_.source_dir, true);
+	watcher.add(config_.static_dir, true);
+	watcher.add(config_.template_dir, true);
+	if(!config_.config_file.empty()) {
+		watcher.add_file(config_.config_file);
+	}
+
+	// outputs exist now, only changes matter
+	config_.rebuild = false;
+
+	LOG_INFO("WATCH: waiting for changes\n");
+	std::fflush(stdout);
+
+	while(1) {
+		std::set<fs::path> changed;
+		watcher.read(-1, changed);
+
+		// wait until burst of events ends
+		while(watcher.read(config_.watch_delay, changed)) {
+		}
+
+		if(!changed.empty()) {
+			// failed rebuild is undone, next change tries again (file removed
+			// meanwhile, broken template, ...)
+			try {
+				process_changes({changed.begin(), changed.end()});
+			} catch(CacheError const& e) {
+				LOG_ERROR("SQLITE ERROR({}): {}\n", e.code(), e.what());
+				cache_.rollback_all();
+				force_ = false;
+			} catch(std::exception const& e) {
+				LOG_ERROR("ERROR: {}\n", e.what());
+				cache_.rollback_all();
+				force_ = false;
+			}
+			std::fflush(stdout);
+		}
+	}
+
+	return 0;
+#else
+	LOG_ERROR("ERROR: watch mode is not supported on this platform\n");
+	return 1;
+#endif
+}
+
+void App::process_changes(std::vector<fs::path> const& changed) {
+	std::vector<fs::path> statics;
+	std::set<fs::path> sources;
+	std::vector<fs::path> removed;
+	bool reload = false;
+
+	for(auto const& path : changed) {
+		if(path == config_.config_file || is_under(path, config_.template_dir)) {
+			reload = true;
+		} else if(!fs::exists(path)) {
+			// deleted or moved away
+			if(is_under(path, config_.static_dir) ||
+				is_under(path, config_.source_dir)) {
+				removed.push_back(path);
+			}
+		} else if(is_under(path, config_.static_dir)) {
+			if(fs::is_regular_file(path)) {
+				statics.push_back(path);
+			}
+		} else if(is_under(path, config_.source_dir)) {
+			if(path.extension() == ".md") {
+				if(fs::is_regular_file(path)) {
+					sources.insert(path);
+				}
+			} else {
+				// file attached to entries, their sources are rendered again
+				// (other files like swap files of editors are not outputs)
+				enum { ID, PATH_ID, PATH, SLUG, FILE_, OWNER };
+				auto source = path.lexically_relative(config_.source_dir).string();
+				cache_.list_source_files(Type::File, source, [&](QueryResult row) {
+					auto owner = fs::path(config_.source_dir) / row[OWNER];
+					if(!row[OWNER].empty() && fs::is_regular_file(owner)) {
+						sources.insert(owner);
+					}
+				});
+			}
+		}
+	}
+
+	if(reload) {
+		LOG_INFO("WATCH: reloading configuration and templates\n");
+		config_ = Config(argc_, argv_);
+		config_.rebuild = false;
+		install_mode_ = config_.static_mode;
+		load_templates();
+	}
+	// also when reload of previous change failed
+	bool all = reload || cache_.state("templates") != templates_hash_;
+	force_ = all;
+
+	bool gone = false;
+	if(!removed.empty()) {
+		cache_.begin("gc");
+		for(auto const& path : removed) {
+			gone = remove_source(path) || gone;
+		}
+		cache_.commit();
+	}
+
+	// nothing of site changed, pages and manifest stay as they are
+	if(!all && !gone && statics.empty() && sources.empty()) {
+		return;
+	}
+
+	cache_.begin("static");
+	for(auto const& path : statics) {
+		process_static_file(path);
+	}
+	cache_.commit();
+
+	cache_.begin("source");
+	if(all) {
+		process_source(list_files(config_.source_dir));
+		cache_.mark_all();
+		cache_.set_state("templates", templates_hash_);
+	} else {
+		for(auto const& path : sources) {
+			process_mkd(path);
+		}
+	}
+	cache_.commit();
+
+	process_pages();
+	write_manifest();
+
+	force_ = false;
+}
+
+bool App::remove_source(fs::path const& path) {
+	enum { ID, PATH_ID, PATH, SLUG, FILE_ };
+
+	std::vector<std::pair<sqlite3_int64, fs::path>> stale;
+	auto add = [&](QueryResult row) {
+		stale.emplace_back(row.int64(ID),
+			fs::path(row[PATH]) / row[SLUG] / row[FILE_]);
+	};
+
+	// markdown file takes its code blocks and attached files with it
+	if(is_under(path, config_.static_dir)) {
+		auto source = path.lexically_relative(config_.static_dir).string();
+		cache_.list_source_files(Type::Static, source, add);
+	} else if(path.extension() == ".md") {
+		auto source = path.lexically_relative(config_.source_dir).string();
+		cache_.list_source_outputs(source, add);
+	} else {
+		auto source = path.lexically_relative(config_.source_dir).string();
+		cache_.list_source_files(Type::File, source, add);
+	}
+
+	for(auto const& [id, info] : stale) {
+		remove_output(id, info);
+	}
+	return !stale.empty();
+}
+
+} // namespace miu
+
@@ -0,0 +1,90 @@
+// built with CHECK_SQL, every query Cache prepares is explained and
+// the call throws when its plan scans or sorts table it should not,
+// so calling everything Cache does once checks all of its queries
+
+#include "cache.hpp"
+#include "filesystem.hpp"
+
+#include <fmt/core.h>
+
+namespace {
+	Entry make_entry(Type type, sqlite3_int64 path, std::string const& slug,
+		std::string const& file) {
+
+		Entry entry;
+		entry.type = type;
+		entry.source = slug.empty() ? file : slug + ".md";
+		entry.path = path;
+		entry.slug = slug;
+		entry.file = file;
+		entry.title = slug;
+		entry.created = "2020-01-01T00:00:00Z";
+		entry.update = false;
+		entry.hash = "0123456789abcdef";
+		entry.mtime = 1;
+		return entry;
+	}
+
+	void run(Cache& cache) {
+		auto ignore = [](QueryResult) {};
+
+		cache.begin("test");
+
+		auto root = cache.path_id("");
+		auto blog = cache.path_id("blog");
+		cache.path_id("blog/2020");
+
+		auto id = cache.add_entry(make_entry(Type::Entry, blog, "post", "index.html"));
+		cache.add_entries({
+			make_entry(Type::Source, blog, "post", "code.c"),
+			make_entry(Type::File, blog, "post", "image.png"),
+			make_entry(Type::Static, root, "", "style.css"),
+		});
+		cache.entry_output(make_entry(Type::Entry, blog, "post", "index.html"));
+		cache.add_tag(id, "one");
+		cache.set_tags(id, {"two", "three"});
+
+		// entry turned into page drops its tags
+		cache.add_entry(make_entry(Type::Page, blog, "post", "index.html"));
+
+		cache.set_state("test", "value");
+		cache.state("test");
+
+		cache.list_dirty_paths(ignore);
+		cache.list_dirty_tags(ignore);
+		cache.list_sources(ignore);
+		cache.list_source_outputs("post.md", ignore);
+		cache.list_source_files(Type::File, "image.png", ignore);
+		cache.last_entries(10, ignore);
+		cache.list_subpaths(blog, ignore);
+		cache.list_entries_path(blog, ignore);
+		cache.list_dirty_tag_entries(ignore);
+		cache.list_tags(ignore);
+
+		cache.remove_entry(id);
+		cache.remove_unused_tags([](std::string const&) {});
+		cache.mark_all();
+		cache.clean();
+
+		cache.commit();
+	}
+}
+
+int main() {
+	auto dir = fs::temp_directory_path() / "miu-sql-plan";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+
+	int ret = 0;
+	try {
+		Cache cache((dir / "cache.db").string());
+		run(cache);
+		fmt::print("{} queries checked\n", cache.stmt_misses());
+	} catch(CacheError const& e) {
+		fmt::print(stderr, "SQLITE ERROR({}): {}\n", e.code(), e.what());
+		ret = 1;
+	}
+
+	fs::remove_all(dir);
+	return ret;
+}